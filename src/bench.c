@@ -0,0 +1,196 @@
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define BENCH_SEED 1
+
+// Fixed workloads, each runs in its own process so peak RSS is its own
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    int spacing; // agents start every spacing cells on both axes
+    long steps;
+    long reinitEvery; // force an extinction every N steps, 0 waits for one
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"default", BOARD_WIDTH, BOARD_HEIGHT, 3, 20000, 0},
+    {"dense", 1024, 1024, 2, 300, 0},
+    {"sparse", 8192, 8192, 64, 300, 0},
+    {"reinit-churn", BOARD_WIDTH, BOARD_HEIGHT, 3, 2000, 25},
+};
+
+#define SCENARIOS_COUNT (int)(sizeof(scenarios)/sizeof(scenarios[0]))
+
+typedef struct {
+    bool ok;
+    long steps;
+    long generations;
+    long agentUpdates; // agents alive at the start of every step
+    double stepSeconds;
+    double reinitSeconds;
+    int agents;
+} Result;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// InitGame and ReinitGame seed every third cell, other spacings start and
+// restart from random genomes
+static void Populate(Game *game, int spacing, bool reinit) {
+    if (spacing == 3) {
+        if (reinit) {
+            ReinitGame(game);
+        } else {
+            InitGame(game);
+        }
+        return;
+    }
+    ClearGame(game);
+    for (int y = 0; y < game->height; y += spacing) {
+        for (int x = 0; x < game->width; x += spacing) {
+            RandomAgent(game, y*game->width + x);
+        }
+    }
+    CreateWallsAndFoods(game);
+}
+
+static Result RunScenario(const Scenario *scenario, GameConfig config) {
+    Result result = {0};
+    config.width = scenario->width;
+    config.height = scenario->height;
+    Game *game = CreateGame(&config);
+    if (game == NULL) return result;
+    Populate(game, scenario->spacing, false);
+
+    result.generations = 1;
+    for (long i = 0; i < scenario->steps; i++) {
+        bool churn = scenario->reinitEvery > 0 && i > 0 && i % scenario->reinitEvery == 0;
+        if (game->allDie || churn) {
+            double start = Now();
+            Populate(game, scenario->spacing, true);
+            result.reinitSeconds += Now() - start;
+            result.generations++;
+        }
+        result.agentUpdates += game->agents.count;
+        double start = Now();
+        StepGame(game);
+        result.stepSeconds += Now() - start;
+    }
+    result.steps = scenario->steps;
+    result.agents = game->agents.count;
+    result.ok = true;
+    DestroyGame(game);
+    return result;
+}
+
+// Runs the scenario in a child and collects its result and peak RSS
+static bool RunIsolated(const Scenario *scenario, const GameConfig *config, Result *result, long *peakRssKb) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Result r = RunScenario(scenario, *config);
+        bool written = write(fds[1], &r, sizeof(r)) == sizeof(r);
+        _exit(written ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], result, sizeof(*result)) == sizeof(*result);
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return false;
+    *peakRssKb = usage.ru_maxrss;
+    return ok && result->ok;
+}
+
+static void Usage(const char *name) {
+    fprintf(stderr, "usage: %s [--scenario NAME] [options]\nscenarios:", name);
+    for (int s = 0; s < SCENARIOS_COUNT; s++) fprintf(stderr, " %s", scenarios[s].name);
+    fprintf(stderr, "\nboard sizes come from the scenario, the seed defaults to %d\n%s", BENCH_SEED, GameOptionsUsage());
+}
+
+int main(int argc, char **argv) {
+    GameConfig config = DefaultGameConfig();
+    config.seed = BENCH_SEED;
+    const char *only = NULL;
+    for (int i = 1; i < argc;) {
+        if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            only = argv[i + 1];
+            i += 2;
+            continue;
+        }
+        int n = ParseGameOption(&config, argc, argv, i);
+        if (n <= 0) {
+            Usage(argv[0]);
+            return 1;
+        }
+        i += n;
+    }
+
+    if (only != NULL) {
+        int s = 0;
+        while (s < SCENARIOS_COUNT && strcmp(only, scenarios[s].name) != 0) s++;
+        if (s == SCENARIOS_COUNT) {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    printf("{\n");
+    printf("  \"seed\": %llu,\n", (unsigned long long)config.seed);
+    printf("  \"engine\": \"%s\",\n", GetEngineOps(config.engine)->name);
+    printf("  \"threads\": %d,\n", config.threads);
+    printf("  \"plane_sensing\": %s,\n", config.planeSensing ? "true" : "false");
+    printf("  \"scenarios\": [");
+    int ran = 0;
+    bool failed = false;
+    for (int s = 0; s < SCENARIOS_COUNT; s++) {
+        const Scenario *scenario = &scenarios[s];
+        if (only != NULL && strcmp(only, scenario->name) != 0) continue;
+
+        Result r;
+        long peakRssKb = 0;
+        if (!RunIsolated(scenario, &config, &r, &peakRssKb)) {
+            fprintf(stderr, "scenario %s failed\n", scenario->name);
+            failed = true;
+            continue;
+        }
+        printf("%s\n    {\n", ran++ ? "," : "");
+        printf("      \"name\": \"%s\",\n", scenario->name);
+        printf("      \"width\": %d,\n", scenario->width);
+        printf("      \"height\": %d,\n", scenario->height);
+        printf("      \"steps\": %ld,\n", r.steps);
+        printf("      \"generations\": %ld,\n", r.generations);
+        printf("      \"agents\": %d,\n", r.agents);
+        printf("      \"agent_updates\": %ld,\n", r.agentUpdates);
+        printf("      \"step_seconds\": %.6f,\n", r.stepSeconds);
+        printf("      \"reinit_seconds\": %.6f,\n", r.reinitSeconds);
+        printf("      \"steps_per_s\": %.1f,\n", r.steps/r.stepSeconds);
+        printf("      \"agent_updates_per_s\": %.1f,\n", r.agentUpdates/r.stepSeconds);
+        // Per-step costs that do not scale with the agents are spread over them
+        printf("      \"avg_step_ns_per_agent\": %.2f,\n", (r.agentUpdates > 0) ? r.stepSeconds*1e9/r.agentUpdates : 0.0);
+        printf("      \"peak_rss_kb\": %ld\n", peakRssKb);
+        printf("    }");
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+#include "bitboard.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void InitBitboard(Bitboard *board, uint64_t *words, int bits) {
+    board->words = words;
+    board->bits = bits;
+    board->wordsCount = (bits + 63)/64;
+    ClearBitboard(board);
+}
+
+void ClearBitboard(Bitboard *board) {
+    memset(board->words, 0, BITBOARD_WORDS(board->bits)*sizeof(uint64_t));
+}
+
+long CountBitboard(const Bitboard *board) {
+    const uint64_t *words = board->words;
+    long count = 0;
+    int w = 0;
+#ifdef __SSE2__
+    // Bit counts summed per byte, then bytes per half with psadbw
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    __m128i sum = _mm_setzero_si128();
+    for (; w + 1 < board->wordsCount; w += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&words[w]);
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    count = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+#endif
+    for (; w < board->wordsCount; w++) count += __builtin_popcountll(words[w]);
+    return count;
+}
+
+// 64 bits of words starting at bit p, reading zeros outside [0, count) words
+static inline uint64_t ReadBits(const uint64_t *words, long count, long p) {
+    long s = (p >= 0) ? p/64 : -((63 - p)/64);
+    int r = (int)(p - s*64);
+    uint64_t lo = (s >= 0 && s < count) ? words[s] : 0;
+    uint64_t hi = (s + 1 >= 0 && s + 1 < count) ? words[s + 1] : 0;
+    return r ? lo >> r | hi << (64 - r) : lo;
+}
+
+// out[w] = ReadBits(in, count, 64*w + offset) for w in [from, to), or'ed
+// into out when merge is set. out and in must not overlap.
+static void FunnelBits(uint64_t *out, long from, long to, const uint64_t *in, long count, long offset, bool merge) {
+    long w = from;
+#ifdef __SSE2__
+    long q = (offset >= 0) ? offset/64 : -((63 - offset)/64);
+    int r = (int)(offset - q*64);
+    for (; w < to && w + q < 0; w++) {
+        uint64_t v = ReadBits(in, count, 64*w + offset);
+        out[w] = merge ? out[w] | v : v;
+    }
+    // Two words per iteration while both loads, in[w+q .. w+q+2], stay
+    // inside in. A shift by 64 yields zero, which covers r == 0.
+    __m128i right = _mm_cvtsi32_si128(r);
+    __m128i left = _mm_cvtsi32_si128(64 - r);
+    for (; w + 1 < to && w + q + 2 < count; w += 2) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)&in[w + q]);
+        __m128i hi = _mm_loadu_si128((const __m128i *)&in[w + q + 1]);
+        __m128i v = _mm_or_si128(_mm_srl_epi64(lo, right), _mm_sll_epi64(hi, left));
+        if (merge) v = _mm_or_si128(v, _mm_loadu_si128((const __m128i *)&out[w]));
+        _mm_storeu_si128((__m128i *)&out[w], v);
+    }
+#endif
+    for (; w < to; w++) {
+        uint64_t v = ReadBits(in, count, 64*w + offset);
+        out[w] = merge ? out[w] | v : v;
+    }
+}
+
+void RotateBitboard(Bitboard *out, const Bitboard *in, long k) {
+    long n = in->bits;
+    long words = in->wordsCount;
+    long count = words + 1;
+    k %= n;
+    if (k < 0) k += n;
+    // The shorter shift covers the bulk, the bits that wrap are or'ed in
+    if (k <= n - k) {
+        FunnelBits(out->words, 0, words, in->words, count, k, false);
+        FunnelBits(out->words, (n - k)/64, words, in->words, count, k - n, true);
+    } else {
+        long m = n - k;
+        FunnelBits(out->words, 0, words, in->words, count, -m, false);
+        FunnelBits(out->words, 0, (m + 63)/64, in->words, count, k, true);
+    }
+    if (n % 64) out->words[words - 1] &= ((uint64_t)1 << (n % 64)) - 1;
+}
+
+void ShiftBitboard(Bitboard *out, const Bitboard *in, int width, int dx, int dy) {
+    RotateBitboard(out, in, (long)dy*width + dx);
+    if (dx == 0) return;
+    // The edge column took its bits from the neighbouring row, wrap it
+    // around its own row instead
+    int x = (dx > 0) ? width - 1 : 0;
+    for (int row = 0; row < in->bits; row += width) {
+        int cell = row + x;
+        uint64_t bit = (uint64_t)1 << (cell & 63);
+        uint64_t *word = &out->words[cell >> 6];
+        *word = TestBitboard(in, row + width - 1 - x) ? *word | bit : *word & ~bit;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef BITBOARD_H_
+#define BITBOARD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One bit per cell, bit (i % 64) of words[i / 64] for the flat cell index
+// i. Bits past the last cell are always zero and a spare zero word follows
+// the last one, so two-word loads never leave the storage.
+typedef struct {
+    uint64_t *words; // BITBOARD_WORDS(bits)
+    int bits;
+    int wordsCount; // without the spare word
+} Bitboard;
+
+#define BITBOARD_WORDS(bits) (((size_t)(bits) + 63)/64 + 1)
+
+void InitBitboard(Bitboard *board, uint64_t *words, int bits);
+void ClearBitboard(Bitboard *board);
+long CountBitboard(const Bitboard *board);
+// out bit i = in bit (i + k) mod bits, any k
+void RotateBitboard(Bitboard *out, const Bitboard *in, long k);
+// Neighbour plane of a width-wide torus: out bit of cell (x, y) = in bit of
+// cell (x + dx, y + dy), one of dx, dy is zero and the other one is +-1
+void ShiftBitboard(Bitboard *out, const Bitboard *in, int width, int dx, int dy);
+
+static inline void SetBitboard(Bitboard *board, int i) {
+    board->words[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+static inline void ResetBitboard(Bitboard *board, int i) {
+    board->words[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
+// For boards whose words are written from several threads at once
+static inline void SetBitboardAtomic(Bitboard *board, int i) {
+    __atomic_fetch_or(&board->words[i >> 6], (uint64_t)1 << (i & 63), __ATOMIC_RELAXED);
+}
+
+static inline void ResetBitboardAtomic(Bitboard *board, int i) {
+    __atomic_fetch_and(&board->words[i >> 6], ~((uint64_t)1 << (i & 63)), __ATOMIC_RELAXED);
+}
+
+static inline bool TestBitboard(const Bitboard *board, int i) {
+    return (board->words[i >> 6] >> (i & 63)) & 1;
+}
+
+#endif
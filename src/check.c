@@ -0,0 +1,337 @@
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Self-checks of simulation invariants, run by make check
+
+static int failures;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            failures++; \
+            printf("  FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+static GameConfig BoardConfig(int width, int height, uint64_t seed) {
+    GameConfig config = DefaultGameConfig();
+    config.width = width;
+    config.height = height;
+    config.seed = seed;
+    return config;
+}
+
+static Game *StartGame(const GameConfig *config) {
+    Game *game = CreateGame(config);
+    if (game == NULL) {
+        fprintf(stderr, "failed to allocate a %dx%d world\n", config->width, config->height);
+        exit(1);
+    }
+    return game;
+}
+
+// A handle whose agent died never resolves again, however often its slot
+// is reused, on a full store where one slot takes every birth
+static void CheckRecycledHandle(void) {
+    GameConfig config = BoardConfig(8, 8, 1);
+    Game *game = StartGame(&config);
+    ClearGame(game);
+    for (int cell = 1; cell < game->cellsCount; cell++) RandomAgent(game, cell);
+    AgentHandle dead = RandomAgent(game, 0);
+    CHECK(IsAgentAlive(game, dead), "new agent is not alive");
+    int slot = dead & game->agents.slotMask;
+    RemoveAgent(game, AgentIndex(game, dead));
+
+    long reuses = 0;
+    for (int i = 0; i < 100000; i++) {
+        AgentHandle handle = RandomAgent(game, 0);
+        reuses += (handle & game->agents.slotMask) == (AgentHandle)slot;
+        CHECK(handle != dead, "reuse %d handed out the dead handle again", i);
+        CHECK(!IsAgentAlive(game, dead), "dead handle resolves after %ld reuses of its slot", reuses);
+        if (failures) break;
+        RemoveAgent(game, AgentIndex(game, handle));
+    }
+    CHECK(reuses >= 256, "slot reused only %ld times", reuses);
+    DestroyGame(game);
+}
+
+// Handles taken at the start of a run stay dead once their agents die
+static void CheckStaleHandles(void) {
+    GameConfig config = BoardConfig(BOARD_WIDTH, BOARD_HEIGHT, 7);
+    Game *game = StartGame(&config);
+    InitGame(game);
+    int count = (game->agents.count < 2000) ? game->agents.count : 2000;
+    AgentHandle *handles = malloc(count*sizeof(AgentHandle));
+    bool *died = calloc(count, sizeof(bool));
+    for (int i = 0; i < count; i++) handles[i] = game->agents.handle[i];
+
+    int aliased = 0;
+    for (long step = 0; step < 20000; step++) {
+        if (game->allDie) ReinitGame(game);
+        StepGame(game);
+        for (int i = 0; i < count; i++) {
+            bool alive = IsAgentAlive(game, handles[i]);
+            aliased += died[i] && alive;
+            died[i] = died[i] || !alive;
+        }
+    }
+    CHECK(aliased == 0, "%d lookups of dead handles found a live agent", aliased);
+    free(handles);
+    free(died);
+    DestroyGame(game);
+}
+
+// The bit planes mirror the cells after serial and concurrent steps, which
+// is what the food, wall and population counts rely on
+static void CheckPlanes(void) {
+    for (Engine engine = 0; engine < ENGINE_COUNT; engine++) {
+        GameConfig config = BoardConfig(67, 45, 3);
+        config.engine = engine;
+        config.threads = 3;
+        Game *game = StartGame(&config);
+        InitGame(game);
+        for (int step = 0; step < 500; step++) {
+            if (game->allDie) ReinitGame(game);
+            StepGame(game);
+        }
+        int mismatches = 0;
+        for (int cell = 0; cell < game->cellsCount; cell++) {
+            Cell value = game->cells[cell];
+            mismatches += TestBitboard(&game->wallBits, cell) != ((value & CELL_WALL) != 0);
+            mismatches += TestBitboard(&game->foodBits, cell) != (CELL_FOOD(value) != 0);
+            mismatches += TestBitboard(&game->agentBits, cell) != ((value & CELL_AGENT) != 0);
+        }
+        CHECK(mismatches == 0, "%s engine: %d plane bits differ from the cells", GetEngineOps(engine)->name, mismatches);
+        CHECK(CountPopulation(game) == game->agents.count, "%s engine: population %d, %d agents",
+            GetEngineOps(engine)->name, CountPopulation(game), game->agents.count);
+        DestroyGame(game);
+    }
+}
+
+// Neighbour shifts and rotations of random planes equal the bit by bit
+// torus wrap, on widths below, at and across the 64-bit word size
+static void CheckShifts(void) {
+    static const int sizes[][2] = {{67, 45}, {64, 4}, {130, 3}, {5, 1}, {1, 7}};
+    static const int shifts[][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    Rng rng;
+    SeedRng(&rng, 1, 0);
+    for (int s = 0; s < (int)(sizeof(sizes)/sizeof(sizes[0])); s++) {
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        int bits = width*height;
+        uint64_t *words = malloc(2*BITBOARD_WORDS(bits)*sizeof(uint64_t));
+        Bitboard in, out;
+        InitBitboard(&in, words, bits);
+        InitBitboard(&out, words + BITBOARD_WORDS(bits), bits);
+        for (int i = 0; i < bits; i++) {
+            if (RngInt(&rng, 0, 1)) SetBitboard(&in, i);
+        }
+        for (int d = 0; d < 4; d++) {
+            int dx = shifts[d][0];
+            int dy = shifts[d][1];
+            ShiftBitboard(&out, &in, width, dx, dy);
+            int wrong = 0;
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int from = (y + dy + height)%height*width + (x + dx + width)%width;
+                    wrong += TestBitboard(&out, y*width + x) != TestBitboard(&in, from);
+                }
+            }
+            CHECK(wrong == 0, "%dx%d shift (%d, %d): %d bits wrong", width, height, dx, dy, wrong);
+        }
+        for (long k = -bits - 3; k <= bits + 3; k += (bits > 200) ? 37 : 1) {
+            RotateBitboard(&out, &in, k);
+            int wrong = 0;
+            for (int i = 0; i < bits; i++) {
+                wrong += TestBitboard(&out, i) != TestBitboard(&in, (int)(((i + k)%bits + bits)%bits));
+            }
+            CHECK(wrong == 0, "%d bits rotated by %ld: %d bits wrong", bits, k, wrong);
+        }
+        CHECK(out.words[out.wordsCount] == 0, "%d bits: the spare word was written", bits);
+        free(words);
+    }
+}
+
+// Masks read from the shifted planes equal the masks read from the cells,
+// and the intents engine steps the same world either way
+static void CheckPlaneSensing(void) {
+    GameConfig config = BoardConfig(67, 45, 5);
+    config.engine = ENGINE_INTENTS;
+    config.threads = 2;
+    Game *cells = StartGame(&config);
+    config.planeSensing = true;
+    Game *planes = StartGame(&config);
+    InitGame(cells);
+    InitGame(planes);
+
+    size_t words = BITBOARD_WORDS(cells->cellsCount);
+    uint64_t *planeWords = malloc(SENSOR_PLANES*words*sizeof(uint64_t));
+    Bitboard neighbours[SENSOR_PLANES];
+    for (int p = 0; p < SENSOR_PLANES; p++) InitBitboard(&neighbours[p], &planeWords[p*words], cells->cellsCount);
+    SensorMask *sensors = malloc(cells->agents.capacity*sizeof(SensorMask));
+    ShiftSensorPlanes(cells, neighbours, 0, SENSOR_PLANES);
+    SenseAgentsFromPlanes(cells, neighbours, 0, neighbours[0].wordsCount, sensors);
+    int wrong = 0;
+    for (int a = 0; a < cells->agents.count; a++) wrong += sensors[a] != SenseAgent(cells, a);
+    CHECK(wrong == 0, "%d of %d agents sensed differently from the planes", wrong, cells->agents.count);
+
+    for (int step = 0; step < 500 && failures == 0; step++) {
+        if (cells->allDie) ReinitGame(cells);
+        if (planes->allDie) ReinitGame(planes);
+        StepGame(cells);
+        StepGame(planes);
+        CHECK(HashGame(cells) == HashGame(planes), "plane sensing changed the world at step %ld", cells->step);
+    }
+    free(sensors);
+    free(planeWords);
+    DestroyGame(cells);
+    DestroyGame(planes);
+}
+
+// HashGame leaves handles out, the replay compares them by cell as well
+static uint64_t HashHandles(const Game *game) {
+    uint64_t hash = 0;
+    for (int a = 0; a < game->agents.count; a++) {
+        hash += ((uint64_t)game->agents.cell[a] << 32 | game->agents.handle[a])*0x9e3779b97f4a7c15ull;
+    }
+    return hash;
+}
+
+// A restored state replays the steps that followed its save hash for hash,
+// across extinctions and into reused slots and genome entries
+static void CheckSavedState(void) {
+    enum { SAVES = 6, STEPS = 300 };
+    GameConfig config = BoardConfig(67, 45, 9);
+    config.hallOfFameCount = 3;
+    Game *game = StartGame(&config);
+    InitGame(game);
+    uint64_t hashes[STEPS];
+    uint64_t handles[STEPS];
+    for (int save = 0; save < SAVES && failures == 0; save++) {
+        GameState *state = SaveGameState(game);
+        CHECK(state != NULL, "failed to save the world");
+        if (state == NULL) break;
+        long start = game->step;
+        for (int step = 0; step < STEPS; step++) {
+            if (game->allDie) ReinitGame(game);
+            StepGame(game);
+            hashes[step] = HashGame(game);
+            handles[step] = HashHandles(game);
+        }
+        RestoreGameState(game, state);
+        CHECK(game->step == start, "restored step %ld, saved at %ld", game->step, start);
+        for (int step = 0; step < STEPS && failures == 0; step++) {
+            if (game->allDie) ReinitGame(game);
+            StepGame(game);
+            CHECK(HashGame(game) == hashes[step], "replay from step %ld differs at step %ld", start, game->step);
+            CHECK(HashHandles(game) == handles[step], "replay from step %ld hands out other handles at step %ld",
+                start, game->step);
+        }
+        CHECK(game->cellsHash == RehashCells(game), "cellsHash drifted after a restore");
+        FreeGameState(state);
+    }
+    DestroyGame(game);
+}
+
+// Random offers from a few genomes keep the heap ordered, one entry per
+// genome, and every entry reachable through the slot table
+static void CheckHallIndex(void) {
+    enum { CAPACITY = 16, GENOMES = 64 };
+    HallEntry entries[CAPACITY];
+    uint64_t genomes[CAPACITY];
+    int positions[CAPACITY];
+    int table[2*CAPACITY];
+    HallOfFame hall;
+    CHECK(HallOfFameTableSize(CAPACITY) <= 2*CAPACITY, "table larger than expected");
+    InitHallOfFame(&hall, entries, genomes, positions, table, CAPACITY, sizeof(uint64_t));
+    Rng rng;
+    SeedRng(&rng, 1, 0);
+    for (int offer = 0; offer < 100000 && failures == 0; offer++) {
+        // Hashes that collide in the low bits exercise the probing
+        uint64_t genome = RngInt(&rng, 0, GENOMES - 1);
+        uint64_t hash = genome << 40 | (genome & 3);
+        OfferHallOfFame(&hall, &genome, hash, RngInt(&rng, 0, 1000));
+
+        int used = 0;
+        for (uint32_t b = 0; b <= hall.tableMask; b++) used += table[b] != HALL_SLOT_NONE;
+        CHECK(used == hall.count, "offer %d: %d table entries for %d genomes", offer, used, hall.count);
+        for (int i = 0; i < hall.count; i++) {
+            CHECK(i == 0 || entries[(i - 1)/2].fitness <= entries[i].fitness, "offer %d: heap out of order", offer);
+            CHECK(positions[entries[i].slot] == i, "offer %d: stale position of entry %d", offer, i);
+            CHECK(*(uint64_t *)GetHallOfFameGenome(&hall, i) << 40 == (entries[i].hash & ~(uint64_t)3),
+                "offer %d: entry %d holds another genome", offer, i);
+            for (int j = 0; j < i; j++) {
+                CHECK(entries[i].hash != entries[j].hash, "offer %d: genome twice in the hall", offer);
+            }
+            uint32_t b = entries[i].hash & hall.tableMask;
+            while (table[b] != HALL_SLOT_NONE && table[b] != entries[i].slot) b = (b + 1) & hall.tableMask;
+            CHECK(table[b] == entries[i].slot, "offer %d: entry %d unreachable in the table", offer, i);
+        }
+    }
+}
+
+// A fatal attack removes the attacker and credits it one kill on its way
+// into the hall of fame; the target survives at zero health
+static void CheckKills(void) {
+    GameConfig config = BoardConfig(8, 8, 1);
+    config.fitness = (Fitness){.kills = 1};
+    Game *game = StartGame(&config);
+    ClearGame(game);
+    Agents *agents = &game->agents;
+    AgentHandle attacker = RandomAgent(game, 2*8 + 2);
+    AgentHandle target = RandomAgent(game, 2*8 + 3);
+    int a = AgentIndex(game, attacker);
+    agents->dir[a] = DIR_RIGHT;
+    agents->health[AgentIndex(game, target)] = 20;
+    uint64_t genome = agents->genomeHash[agents->genome[a]];
+
+    ExecuteAction(game, a, ACTION_ATTACK);
+    CHECK(IsAgentAlive(game, attacker) && agents->kills[AgentIndex(game, attacker)] == 0,
+        "a wounding attack removed the attacker or counted a kill");
+    CHECK(game->hall.count == 0, "nothing died, the hall has %d entries", game->hall.count);
+
+    ExecuteAction(game, AgentIndex(game, attacker), ACTION_ATTACK);
+    CHECK(!IsAgentAlive(game, attacker), "the attacker survived a fatal attack");
+    CHECK(IsAgentAlive(game, target), "the target of a fatal attack was removed");
+    CHECK(IsAgentAlive(game, target) && agents->health[AgentIndex(game, target)] == 0,
+        "the target is not at zero health");
+    CHECK(game->hall.count == 1 && game->hall.entries[0].hash == genome && game->hall.entries[0].fitness == 1,
+        "the hall did not get the attacker's genome with one kill");
+    DestroyGame(game);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} Check;
+
+static const Check checks[] = {
+    {"recycled-handle", CheckRecycledHandle},
+    {"stale-handles", CheckStaleHandles},
+    {"planes", CheckPlanes},
+    {"shifts", CheckShifts},
+    {"plane-sensing", CheckPlaneSensing},
+    {"saved-state", CheckSavedState},
+    {"hall-index", CheckHallIndex},
+    {"kills", CheckKills},
+};
+
+#define CHECKS_COUNT (int)(sizeof(checks)/sizeof(checks[0]))
+
+int main(int argc, char **argv) {
+    int failed = 0;
+    for (int c = 0; c < CHECKS_COUNT; c++) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++) selected = selected || strcmp(argv[i], checks[c].name) == 0;
+        if (!selected) continue;
+        int before = failures;
+        checks[c].run();
+        printf("%s %s\n", (failures == before) ? "ok  " : "FAIL", checks[c].name);
+        failed += failures != before;
+    }
+    if (failed) printf("%d checks failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include "game.h"
+#include "profile.h"
 #include "raylib.h"
 #include "raymath.h"
 #include <stdio.h>
@@ -7,48 +8,6 @@
 #include <string.h>
 #include <time.h>
 
-char *DirToStr(Dir dir) {
-    switch (dir) {
-        case DIR_UP: return "DIR_UP";
-        case DIR_LEFT: return "DIR_LEFT";
-        case DIR_DOWN: return "DIR_DOWN";
-        case DIR_RIGHT: return "DIR_RIGHT";
-        default: return "";
-    }
-}
-
-char *ConditionToStr(Condition cond) {
-    switch (cond) {
-        case CONDITION_ALWAYS: return "CONDITION_ALWAYS";
-        case CONDITION_LEFT_IS_FREE: return "CONDITION_LEFT_IS_FREE";
-        case CONDITION_RIGHT_IS_FREE: return "CONDITION_RIGHT_IS_FREE";
-        case CONDITION_FRONT_IS_FREE: return "CONDITION_FRONT_IS_FREE";
-        case CONDITION_FOOD_IN_FRONT: return "CONDITION_FOOD_IN_FRONT";
-        case CONDITION_FOOD_ON_LEFT: return "CONDITION_FOOD_ON_LEFT";
-        case CONDITION_FOOD_ON_RIGHT: return "CONDITION_FOOD_ON_RIGHT";
-        case CONDITION_AGENT_IN_FRONT: return "CONDITION_AGENT_IN_FRONT";
-        case CONDITION_AGENT_ON_LEFT: return "CONDITION_AGENT_ON_LEFT";
-        case CONDITION_AGENT_ON_RIGHT: return "CONDITION_AGENT_ON_RIGHT";
-        case CONDITION_WALL_IN_FRONT: return "CONDITION_WALL_IN_FRONT";
-        case CONDITION_WALL_ON_LEFT: return "CONDITION_WALL_ON_LEFT";
-        case CONDITION_WALL_ON_RIGHT: return "CONDITION_WALL_ON_RIGHT";
-        default: return "";
-    }
-}
-
-char *ActionToStr(Action action) {
-    switch (action) {
-        case ACTION_MOVE: return "ACTION_MOVE";
-        case ACTION_ATTACK: return "ACTION_ATTACK";
-        case ACTION_EAT: return "ACTION_EAT";
-        case ACTION_DO_NOTHING: return "ACTION_DO_NOTHING";
-        case ACTION_TURN_LEFT: return "ACTION_TURN_LEFT";
-        case ACTION_TURN_RIGHT: return "ACTION_TURN_RIGHT";
-        case ACTION_REPRODUCE: return "ACTION_REPRODUCE";
-        default: return "";
-    }
-}
-
 void DrawWall(Vector2 pos) {
     DrawRectanglePro((Rectangle){pos.x*CELL_SIZE, pos.y*CELL_SIZE, CELL_SIZE, CELL_SIZE}, (Vector2){-0.5f, -0.5f}, 0, GRAY);
 }
@@ -57,9 +16,9 @@ void DrawFood(Vector2 pos) {
     DrawCircleV(Vector2Scale(Vector2AddValue(pos, 0.5), CELL_SIZE), CELL_SIZE/4.0f, ORANGE);
 }
 
-void DrawAgent(Vector2 pos, Agent *agent) {
+void DrawAgent(Vector2 pos, Dir dir) {
     float startAngle = 0;
-    switch (agent->dir) {
+    switch (dir) {
         case DIR_UP: startAngle = 315; break;
         case DIR_LEFT: startAngle = 225; break;
         case DIR_DOWN: startAngle = 135; break;
@@ -76,411 +35,233 @@ void DrawAgent(Vector2 pos, Agent *agent) {
 }
 
 void DrawAgentInfo(Agent *agent, Vector2 pos) {
+    PROFILE_ZONE("DrawAgentInfo");
     DrawText(TextFormat("Health: %d", agent->health), pos.x, pos.y, 20, WHITE);
     DrawText(TextFormat("Hunger: %d", agent->hunger), pos.x, pos.y + 20, 20, WHITE);
     DrawText(TextFormat("Dir: %s", DirToStr(agent->dir)), pos.x, pos.y + 40, 20, WHITE);
     DrawText(TextFormat("Gene index: %d", agent->geneIndex), pos.x, pos.y + 60, 20, WHITE);
-    for (size_t i = 0; i < GENES_COUNT; i++) {
+    DrawText(TextFormat("Age: %ld Offspring: %d Food: %d Kills: %d", agent->age, agent->offspring, agent->foodEaten, agent->kills), pos.x, pos.y + 80, 20, WHITE);
+    for (int i = 0; i < agent->genesCount; i++) {
+        Gene gene = UnpackGene(agent->genes[i]);
         DrawText(TextFormat(
             "Gene %d: %s %s %d %s %d",
             i,
-            ConditionToStr(agent->genes[i].cond),
-            ActionToStr(agent->genes[i].action1),
-            agent->genes[i].next1,
-            ActionToStr(agent->genes[i].action2),
-            agent->genes[i].next2
-       ), pos.x, pos.y+80+i*20, 20, (agent->geneIndex == i) ? PINK : WHITE);
+            ConditionToStr(gene.cond),
+            ActionToStr(gene.action1),
+            gene.next1,
+            ActionToStr(gene.action2),
+            gene.next2
+       ), pos.x, pos.y+100+i*20, 20, (agent->geneIndex == i) ? PINK : WHITE);
     }
 }
 
-void DrawGame(Game *game, Camera2D *camera) {
+void DrawGame(Snapshot *snapshot, Camera2D *camera) {
+    PROFILE_ZONE("DrawGame");
+    int width = snapshot->width;
+    int height = snapshot->height;
     // Draw borders
     // DrawRectangleLines(), doesn't work perfect
-    DrawLine(0, 0, 0, CELL_SIZE*BOARD_HEIGHT, GRAY);
-    DrawLine(0, 0, CELL_SIZE*BOARD_WIDTH, 0, GRAY);
-    DrawLine(CELL_SIZE*BOARD_WIDTH, 0, CELL_SIZE*BOARD_WIDTH, CELL_SIZE*BOARD_HEIGHT, GRAY);
-    DrawLine(0, CELL_SIZE*BOARD_HEIGHT, CELL_SIZE*BOARD_WIDTH, CELL_SIZE*BOARD_HEIGHT, GRAY);
+    DrawLine(0, 0, 0, CELL_SIZE*height, GRAY);
+    DrawLine(0, 0, CELL_SIZE*width, 0, GRAY);
+    DrawLine(CELL_SIZE*width, 0, CELL_SIZE*width, CELL_SIZE*height, GRAY);
+    DrawLine(0, CELL_SIZE*height, CELL_SIZE*width, CELL_SIZE*height, GRAY);
+    // Only the cells inside the view are drawn, boards can be huge
+    Vector2 viewMin = GetScreenToWorld2D((Vector2){0, 0}, *camera);
+    Vector2 viewMax = GetScreenToWorld2D((Vector2){GetScreenWidth(), GetScreenHeight()}, *camera);
+    int x0 = Clamp(floorf(viewMin.x/CELL_SIZE), 0, width);
+    int y0 = Clamp(floorf(viewMin.y/CELL_SIZE), 0, height);
+    int x1 = Clamp(ceilf(viewMax.x/CELL_SIZE), 0, width);
+    int y1 = Clamp(ceilf(viewMax.y/CELL_SIZE), 0, height);
     // Draw grid
     if (camera->zoom >= 1) {
-        for (int y = 1; y < BOARD_HEIGHT; y++) {
-            DrawLine(0, y*CELL_SIZE, BOARD_WIDTH*CELL_SIZE, y*CELL_SIZE, GRAY);
+        for (int y = (y0 > 1) ? y0 : 1; y < y1; y++) {
+            DrawLine(x0*CELL_SIZE, y*CELL_SIZE, x1*CELL_SIZE, y*CELL_SIZE, GRAY);
         }
-        for (int x = 1; x < BOARD_WIDTH; x++) {
-            DrawLine(x*CELL_SIZE, 0, x*CELL_SIZE, BOARD_HEIGHT*CELL_SIZE, GRAY);
+        for (int x = (x0 > 1) ? x0 : 1; x < x1; x++) {
+            DrawLine(x*CELL_SIZE, y0*CELL_SIZE, x*CELL_SIZE, y1*CELL_SIZE, GRAY);
         }
     }
     // Draw world
-    for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH; x++) {
-            if (game->agents[y][x] != NULL) {
-                DrawAgent((Vector2){x, y}, game->agents[y][x]);
-            } else if (game->walls[y][x] != 0) {
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            unsigned char cell = snapshot->cells[y*width + x];
+            if (cell >= VIEW_AGENT) {
+                DrawAgent((Vector2){x, y}, cell - VIEW_AGENT);
+            } else if (cell == VIEW_WALL) {
                 DrawWall((Vector2){x, y});
-            } else if (game->foods[y][x] != 0) {
+            } else if (cell == VIEW_FOOD) {
                 DrawFood((Vector2){x, y});
             }
         }
     }
 }
 
-Dir RandomDir(void) {
-    return GetRandomValue(0, 3);
-}
-
-Condition RandomCondition(void) {
-    return GetRandomValue(0, CONDITION_COUNT-1);
-}
-
-Action RandomAction(void) {
-    return GetRandomValue(0, ACTION_COUNT-1);
-}
-
-Agent *RandomAgent(void) {
-    Agent *a = malloc(sizeof(Agent));
-    a->dir = RandomDir();
-    a->health = HEALTH_MAX;
-    a->hunger = 100;
-    a->geneIndex = GetRandomValue(0, GENES_COUNT-1);
-    for (size_t i = 0; i < GENES_COUNT; i++) {
-        a->genes[i].cond = RandomCondition();
-        a->genes[i].action1 = RandomAction();
-        a->genes[i].action2 = RandomAction();
-        a->genes[i].next1 = GetRandomValue(0, GENES_COUNT-1);
-        a->genes[i].next2 = GetRandomValue(0, GENES_COUNT-1);
-    }
-    return a;
-}
-
-Dir GetReverseDir(Dir dir) {
-    switch (dir) {
-        case DIR_LEFT: return DIR_RIGHT;
-        case DIR_DOWN: return DIR_UP;
-        case DIR_RIGHT: return DIR_LEFT;
-        case DIR_UP: return DIR_DOWN;
-        default: return 0;
+void FreeSnapshotBuffer(SnapshotBuffer *sb) {
+    for (int i = 0; i < 3; i++) {
+        free(sb->buffers[i].cells);
     }
 }
 
-void KillAgent(Game *game, Agent *agent, Vector2 pos) {
-    // shift by 1 element to right
-    memmove(&game->bestGenes[1], &game->bestGenes[0], (BEST_GENES_COUNT-1)*GENES_COUNT*sizeof(Gene));
-    // set first element to curent genes
-    memcpy(&game->bestGenes[0], &agent->genes, GENES_COUNT*sizeof(Gene));
-    
-    game->bestGenesCount = Clamp(game->bestGenesCount+1, 0, BEST_GENES_COUNT);
-
-    game->foods[(int)pos.y][(int)pos.x] = (agent->hunger > 10) ? agent->hunger : 10;
-    
-    free(agent);
-    game->agents[(int)pos.y][(int)pos.x] = NULL;
-}
-
-Agent *ReproduceAgent(Agent *parent) {
-    Agent *a = malloc(sizeof(Agent));
-    a->dir = GetReverseDir(parent->dir);
-    a->health = HEALTH_MAX;
-    a->hunger = parent->hunger/2;
-    parent->hunger /= 2;
-    a->health = parent->health;
-    a->geneIndex = GetRandomValue(0, GENES_COUNT-1);
-    for (size_t i = 0; i < GENES_COUNT; i++) {
-        a->genes[i].cond = parent->genes[i].cond;
-        a->genes[i].action1 = parent->genes[i].action1;
-        a->genes[i].action2 = parent->genes[i].action2;
-        a->genes[i].next1 = parent->genes[i].next1;
-        a->genes[i].next2 = parent->genes[i].next2;
-        if (GetRandomValue(0, 100) <= 10) {
-            int m = GetRandomValue(0, 4); // cond, action1, action2, ...
-            switch (m) {
-                case 0: a->genes[i].cond = RandomCondition(); break;
-                case 1: a->genes[i].action1 = RandomAction(); break;
-                case 2: a->genes[i].action2 = RandomAction(); break;
-                case 3: a->genes[i].next1 = GetRandomValue(0, GENES_COUNT-1); break;
-                case 4: a->genes[i].next2 = GetRandomValue(0, GENES_COUNT-1); break;
-            }
+// Returns false, with nothing left allocated, if a buffer does not fit
+bool InitSnapshotBuffer(SnapshotBuffer *sb, int width, int height) {
+    memset(sb->buffers, 0, sizeof(sb->buffers));
+    for (int i = 0; i < 3; i++) {
+        sb->buffers[i].width = width;
+        sb->buffers[i].height = height;
+        sb->buffers[i].cells = calloc((size_t)width*height, 1);
+        if (sb->buffers[i].cells == NULL) {
+            FreeSnapshotBuffer(sb);
+            return false;
         }
     }
-    return a;
+    sb->back = 0;
+    atomic_init(&sb->shared, 1);
+    sb->front = 2;
+    return true;
 }
 
-Vector2 ToBoardPos(Vector2 pos) {
-    pos.x = (int)pos.x % BOARD_WIDTH;
-    if (pos.x < 0) pos.x += BOARD_WIDTH;
-    pos.y = (int)pos.y % BOARD_HEIGHT;
-    if (pos.y < 0) pos.y += BOARD_HEIGHT;
-    return pos;
+Snapshot *BeginPublishSnapshot(SnapshotBuffer *sb) {
+    return &sb->buffers[sb->back];
 }
 
-bool IsCellFree(Game *game, Vector2 pos) {
-    if (game->agents[(int)pos.y][(int)pos.x] == NULL &&
-        game->walls[(int)pos.y][(int)pos.x] == 0 &&
-        game->foods[(int)pos.y][(int)pos.x] == 0) {
-        return true;
-    }
-    return false;
-}
-
-Vector2 GetFrontPos(Dir dir, Vector2 pos) {
-    switch (dir) {
-        case DIR_UP: pos.y--; break;
-        case DIR_DOWN: pos.y++; break;
-        case DIR_LEFT: pos.x--; break;
-        case DIR_RIGHT: pos.x++; break;
-        default: break;
-    }
-    return ToBoardPos(pos);
-}
-
-Vector2 GetBackPos(Dir dir, Vector2 pos) {
-    switch (dir) {
-        case DIR_UP: pos.y++; break;
-        case DIR_DOWN: pos.y--; break;
-        case DIR_LEFT: pos.x++; break;
-        case DIR_RIGHT: pos.x--; break;
-        default: break;
-    }
-    return ToBoardPos(pos);
-}
-
-Vector2 GetLeftPos(Dir dir, Vector2 pos) {
-    switch (dir) {
-        case DIR_UP: pos.x--; break;
-        case DIR_DOWN: pos.x++; break;
-        case DIR_LEFT: pos.y++; break;
-        case DIR_RIGHT: pos.y--; break;
-        default: break;
-    }
-    return ToBoardPos(pos);
-}
-
-Vector2 GetRightPos(Dir dir, Vector2 pos) {
-    switch (dir) {
-        case DIR_UP: pos.x++; break;
-        case DIR_DOWN: pos.x--; break;
-        case DIR_LEFT: pos.y--; break;
-        case DIR_RIGHT: pos.y++; break;
-        default: break;
-    }
-    return ToBoardPos(pos);
-}
-
-Dir TurnLeft(Dir dir) {
-    switch (dir) {
-        case DIR_LEFT: return DIR_DOWN;
-        case DIR_DOWN: return DIR_RIGHT;
-        case DIR_RIGHT: return DIR_UP;
-        case DIR_UP: return DIR_LEFT;
-    }
-    return 0;
+void EndPublishSnapshot(SnapshotBuffer *sb) {
+    int prev = atomic_exchange_explicit(&sb->shared, sb->back | SNAPSHOT_FRESH, memory_order_acq_rel);
+    sb->back = prev & ~SNAPSHOT_FRESH;
 }
 
-Dir TurnRight(Dir dir) {
-    switch (dir) {
-        case DIR_LEFT: return DIR_UP;
-        case DIR_DOWN: return DIR_LEFT;
-        case DIR_RIGHT: return DIR_DOWN;
-        case DIR_UP: return DIR_RIGHT;
+Snapshot *AcquireSnapshot(SnapshotBuffer *sb) {
+    if (atomic_load_explicit(&sb->shared, memory_order_relaxed) & SNAPSHOT_FRESH) {
+        int prev = atomic_exchange_explicit(&sb->shared, sb->front, memory_order_acq_rel);
+        sb->front = prev & ~SNAPSHOT_FRESH;
     }
-    return 0;
-}
-
-void ExecuteAction(Game *game, Agent *agent, Vector2 pos, Action action) {
-    switch (action) {
-        case ACTION_DO_NOTHING: break;
-        case ACTION_MOVE: {
-            Vector2 front = GetFrontPos(agent->dir, pos);
-            if (IsCellFree(game, front)) {
-                game->agents[(int)front.y][(int)front.x] = agent;
-                game->agents[(int)pos.y][(int)pos.x] = NULL;
-            }
-        } break;
-        case ACTION_TURN_LEFT: {
-            agent->dir = TurnLeft(agent->dir);
-        } break;
-        case ACTION_TURN_RIGHT: {
-            agent->dir = TurnRight(agent->dir);
-        } break;
-        case ACTION_ATTACK: {
-            Vector2 front = GetFrontPos(agent->dir, pos);
-            int fx = (int)front.x;
-            int fy = (int)front.y;
-            if (game->agents[fy][fx] != NULL) {
-                game->agents[fy][fx]->health -= 10;
-                if (game->agents[fy][fx]->health <= 0) {
-                    KillAgent(game, agent, pos);
-                }
-            }
-        } break;
-        case ACTION_EAT: {
-            Vector2 front = GetFrontPos(agent->dir, pos);
-            int fx = (int)front.x;
-            int fy = (int)front.y;
-            if (game->foods[fy][fx] != 0) {
-                agent->hunger += game->foods[fy][fx];
-                game->foods[fy][fx] = 0;
-            }
-        } break;
-        case ACTION_REPRODUCE: {
-            Vector2 back = GetBackPos(agent->dir, pos);
-            int bx = (int)back.x;
-            int by = (int)back.y;
-            if (IsCellFree(game, back)) {
-                game->agents[by][bx] = ReproduceAgent(agent);
-            }
-        } break;
-        default: break;
+    return &sb->buffers[sb->front];
+}
+
+void FillSnapshot(Snapshot *snapshot, Game *game, AgentHandle selected, long steps) {
+    PROFILE_ZONE("FillSnapshot");
+    for (int cell = 0; cell < game->cellsCount; cell++) {
+        if (game->grid[cell] != AGENT_NONE) {
+            snapshot->cells[cell] = VIEW_AGENT + game->agents.dir[AgentIndex(game, game->grid[cell])];
+        } else if (game->cells[cell] & CELL_WALL) {
+            snapshot->cells[cell] = VIEW_WALL;
+        } else if (CELL_FOOD(game->cells[cell]) != 0) {
+            snapshot->cells[cell] = VIEW_FOOD;
+        } else {
+            snapshot->cells[cell] = VIEW_EMPTY;
+        }
     }
-}
+    int agent = AgentIndex(game, selected);
+    snapshot->hasSelected = agent >= 0;
+    if (snapshot->hasSelected) snapshot->selected = GetAgent(game, agent);
+    snapshot->steps = steps;
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Owns the Game exclusively; the render thread only sees published snapshots
+void *SimThreadMain(void *arg) {
+    SimThread *sim = arg;
+    Game *game = sim->game;
+    PROFILE_THREAD("sim", -1);
+    AgentHandle selected = AGENT_NONE;
+    long steps = 0;
+    double lastPublish = 0;
+    bool dirty = true;
+
+    while (atomic_load(&sim->running)) {
+        int select = atomic_exchange(&sim->selectRequest, -1);
+        if (select >= 0) {
+            selected = game->grid[select];
+            dirty = true;
+        }
 
-bool ExecuteCondition(Game *game, Agent *agent, Vector2 pos, Condition cond) {
-    switch (cond) {
-        case CONDITION_ALWAYS: return true;
-        case CONDITION_FRONT_IS_FREE: return IsCellFree(game, GetFrontPos(agent->dir, pos));
-        case CONDITION_LEFT_IS_FREE: return IsCellFree(game, GetLeftPos(agent->dir, pos));
-        case CONDITION_RIGHT_IS_FREE: return IsCellFree(game, GetRightPos(agent->dir, pos));
-        case CONDITION_FOOD_IN_FRONT: {
-            Vector2 front = GetFrontPos(agent->dir, pos);
-            return game->foods[(int)front.y][(int)front.x] != 0;
-        };
-        case CONDITION_FOOD_ON_LEFT: {
-            Vector2 left = GetLeftPos(agent->dir, pos);
-            return game->foods[(int)left.y][(int)left.x] != 0;
-        };
-        case CONDITION_FOOD_ON_RIGHT: {
-            Vector2 right = GetRightPos(agent->dir, pos);
-            return game->foods[(int)right.y][(int)right.x] != 0;
-        };
-        case CONDITION_AGENT_IN_FRONT: {
-            Vector2 front = GetFrontPos(agent->dir, pos);
-            return game->agents[(int)front.y][(int)front.x] != NULL;
-        };
-        case CONDITION_AGENT_ON_LEFT: {
-            Vector2 left = GetLeftPos(agent->dir, pos);
-            return game->agents[(int)left.y][(int)left.x] != NULL;
-        };
-        case CONDITION_AGENT_ON_RIGHT: {
-            Vector2 right = GetRightPos(agent->dir, pos);
-            return game->agents[(int)right.y][(int)right.x] != NULL;
-        };
-        case CONDITION_WALL_IN_FRONT: {
-            Vector2 front = GetFrontPos(agent->dir, pos);
-            return game->walls[(int)front.y][(int)front.x] != 0;
-        };
-        case CONDITION_WALL_ON_LEFT: {
-            Vector2 left = GetLeftPos(agent->dir, pos);
-            return game->walls[(int)left.y][(int)left.x] != 0;
-        };
-        case CONDITION_WALL_ON_RIGHT: {
-            Vector2 right = GetRightPos(agent->dir, pos);
-            return game->walls[(int)right.y][(int)right.x] != 0;
-        };
-        default: return true;
-    }
-}
+        bool stepped = false;
+        if (atomic_load(&sim->turbo)) {
+            if (game->allDie) ReinitGame(game);
+            StepGame(game);
+            stepped = true;
+        } else if (atomic_load(&sim->pendingSteps) > 0) {
+            atomic_fetch_sub(&sim->pendingSteps, 1);
+            if (game->allDie) ReinitGame(game);
+            StepGame(game);
+            stepped = true;
+        }
+        if (stepped) {
+            steps++;
+            atomic_store_explicit(&sim->steps, steps, memory_order_relaxed);
+            dirty = true;
+        }
 
-void UpdateAgent(Game *game, Agent *agent, Vector2 pos) {
-    agent->wasUpdated = true;
-    agent->hunger -= 5;
-    if (agent->hunger < 0) {
-        agent->hunger = 0;
-        agent->health -= 10;
-        if (agent->health <= 0) {
-            KillAgent(game, agent, pos);
-            return;
+        // In turbo mode only publish once per frame budget, otherwise after every change
+        double now = Now();
+        double interval = atomic_load(&sim->turbo) ? atomic_load(&sim->turboBudgetUs)/1e6 : 0;
+        if (dirty && now - lastPublish >= interval) {
+            FillSnapshot(BeginPublishSnapshot(&sim->snapshots), game, selected, steps);
+            EndPublishSnapshot(&sim->snapshots);
+            lastPublish = now;
+            dirty = false;
         }
-    }
-    if (ExecuteCondition(game, agent, pos, agent->genes[agent->geneIndex].cond)) {
-        ExecuteAction(game, agent, pos, agent->genes[agent->geneIndex].action1);
-        agent->geneIndex = agent->genes[agent->geneIndex].next1;
-    } else {
-        ExecuteAction(game, agent, pos, agent->genes[agent->geneIndex].action2);
-        agent->geneIndex = agent->genes[agent->geneIndex].next2;
-    }
-}
 
-void StepGame(Game *game) {
-    for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH; x++) {
-            if (game->agents[y][x] != NULL && !game->agents[y][x]->wasUpdated) {
-                UpdateAgent(game, game->agents[y][x], (Vector2){x, y});
-            }
+        if (!stepped && !dirty) {
+            nanosleep(&(struct timespec){0, 1000000}, NULL);
         }
     }
-    game->allDie = true;
-    for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH; x++) {
-            if (game->agents[y][x] != NULL) {
-                game->agents[y][x]->wasUpdated = false;
-                game->allDie = false;
-            }
+    return NULL;
+}
+
+bool StartSimThread(SimThread *sim, Game *game) {
+    sim->game = game;
+    if (!InitSnapshotBuffer(&sim->snapshots, game->width, game->height)) return false;
+    atomic_init(&sim->running, true);
+    atomic_init(&sim->turbo, false);
+    atomic_init(&sim->turboBudgetUs, TURBO_BUDGET_MS*1000);
+    atomic_init(&sim->pendingSteps, 0);
+    atomic_init(&sim->selectRequest, -1);
+    atomic_init(&sim->steps, 0);
+    pthread_create(&sim->thread, NULL, SimThreadMain, sim);
+    return true;
+}
+
+void StopSimThread(SimThread *sim) {
+    atomic_store(&sim->running, false);
+    pthread_join(sim->thread, NULL);
+    FreeSnapshotBuffer(&sim->snapshots);
+}
+
+int main(int argc, char **argv) {
+    GameConfig config = DefaultGameConfig();
+    const char *profilePath = NULL;
+    for (int i = 1; i < argc;) {
+        if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profilePath = argv[i + 1];
+            i += 2;
+            continue;
         }
-    }
-}
-
-void CreateWallsAndFoods(Game *game) {
-    for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH; x++) {
-            if (IsCellFree(game, (Vector2){x, y})) {
-                if (GetRandomValue(0, 100) <= 1) {
-                    game->walls[y][x] = 1;
-                } else if (GetRandomValue(0, 100) <= 30) {
-                    game->foods[y][x] = 50;
-                }
-            }
+        int n = ParseGameOption(&config, argc, argv, i);
+        if (n <= 0) {
+            fprintf(stderr, "usage: %s [--profile FILE] [options]\n"
+                "  --profile FILE    write a Chrome trace of the timing zones on exit (make PROFILE=1)\n"
+                "%s", argv[0], GameOptionsUsage());
+            return 1;
         }
+        i += n;
     }
-}
-
-void InitGame(Game *game) {
-    memset(game, 0, sizeof(*game));
-    
-    int step = 3;
-    for (int y = 0; y < BOARD_HEIGHT; y += step) {
-        for (int x = 0; x < BOARD_WIDTH; x += step) {
-            game->agents[y][x] = RandomAgent();
-        }
+    if (profilePath != NULL && !PROFILE_ENABLED) {
+        fprintf(stderr, "--profile needs a build with timing zones, make clean && make PROFILE=1\n");
+        return 1;
     }
-    
-    CreateWallsAndFoods(game);
-}
 
-Agent *AgentFromGenes(Gene genes[GENES_COUNT]) {
-    Agent *a = malloc(sizeof(Agent));
-    a->dir = RandomDir();
-    a->health = HEALTH_MAX;
-    a->hunger = 100;
-    a->geneIndex = GetRandomValue(0, GENES_COUNT - 1);
-    for (size_t i = 0; i < GENES_COUNT; i++) {
-        a->genes[i] = genes[i];
+    Game *game = CreateGame(&config);
+    if (game == NULL) {
+        fprintf(stderr, "failed to allocate a %dx%d world\n", config.width, config.height);
+        return 1;
     }
-    return a;
-}
-
-void ReinitGame(Game *game) {
-    Gene bestGenes[BEST_GENES_COUNT][GENES_COUNT];
-    memcpy(bestGenes, game->bestGenes, BEST_GENES_COUNT*GENES_COUNT*sizeof(Gene));
-    int bestGenesCount = game->bestGenesCount;
-
-    memset(game, 0, sizeof(*game));
-
-    int step = 3;
-    for (int y = 0; y < BOARD_HEIGHT; y += step) {
-        for (int x = 0; x < BOARD_WIDTH; x += step) {
-            if (GetRandomValue(0, 100) <= 70) {
-                game->agents[y][x] = AgentFromGenes(bestGenes[GetRandomValue(0, bestGenesCount-1)]);
-            } else {
-                game->agents[y][x] = RandomAgent();
-            }
-        }
-    } 
-
-    CreateWallsAndFoods(game);
-}
-
-int main(void) {
-    SetRandomSeed(time(0));
-    Game game = {0};
-    InitGame(&game);
+    InitGame(game);
+    PROFILE_THREAD("render", -1);
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Live");
 
@@ -488,10 +269,23 @@ int main(void) {
     camera.zoom = 1.0f;
 
     SetTargetFPS(60);
-    
-    Agent *selectedAgent = NULL;
+
+    static SimThread sim;
+    if (!StartSimThread(&sim, game)) {
+        fprintf(stderr, "failed to allocate the %dx%d snapshots\n", game->width, game->height);
+        CloseWindow();
+        DestroyGame(game);
+        return 1;
+    }
+
+    bool turbo = false;
+    double turboBudgetMs = TURBO_BUDGET_MS;
+    long stepsCounted = atomic_load(&sim.steps);
+    double stepsCountStart = GetTime();
+    double stepsPerSecond = 0;
 
     while (!WindowShouldClose()) {
+        PROFILE_ZONE("frame");
         // Update
         if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
             Vector2 delta = Vector2Scale(GetMouseDelta(), -1.0f/camera.zoom);
@@ -500,7 +294,11 @@ int main(void) {
         
         if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) {
             Vector2 mouseWorldPos = GetScreenToWorld2D(GetMousePosition(), camera);
-            selectedAgent = game.agents[(int)mouseWorldPos.y/CELL_SIZE][(int)mouseWorldPos.x/CELL_SIZE];
+            int x = (int)mouseWorldPos.x/CELL_SIZE;
+            int y = (int)mouseWorldPos.y/CELL_SIZE;
+            if (mouseWorldPos.x >= 0 && x < game->width && mouseWorldPos.y >= 0 && y < game->height) {
+                atomic_store(&sim.selectRequest, y*game->width + x);
+            }
         }
 
         float wheel = GetMouseWheelMove();
@@ -514,30 +312,54 @@ int main(void) {
             camera.zoom = Clamp(camera.zoom*scaleFactor, 0.125f, 64.0f);
         }
 
+        if (IsKeyPressed(KEY_T)) {
+            turbo = !turbo;
+            atomic_store(&sim.turbo, turbo);
+        }
+        if (IsKeyPressed(KEY_LEFT_BRACKET)) turboBudgetMs = Clamp(turboBudgetMs - 1, 1, 1000);
+        if (IsKeyPressed(KEY_RIGHT_BRACKET)) turboBudgetMs = Clamp(turboBudgetMs + 1, 1, 1000);
+        atomic_store(&sim.turboBudgetUs, turboBudgetMs*1000);
+
+        // Outside of turbo mode the simulation does at most one step per frame
         if (IsKeyDown(KEY_SPACE)) {
-            if (game.allDie) ReinitGame(&game);
-            StepGame(&game);
+            atomic_store(&sim.pendingSteps, 1);
         } else if (IsKeyPressed(KEY_ENTER)) {
-            if (game.allDie) ReinitGame(&game);
-            StepGame(&game);
+            atomic_fetch_add(&sim.pendingSteps, 1);
+        }
+
+        double now = GetTime();
+        if (now - stepsCountStart >= 1.0) {
+            long steps = atomic_load(&sim.steps);
+            stepsPerSecond = (steps - stepsCounted)/(now - stepsCountStart);
+            stepsCounted = steps;
+            stepsCountStart = now;
         }
 
+        Snapshot *snapshot = AcquireSnapshot(&sim.snapshots);
+
         // Draw
         BeginDrawing();
             ClearBackground(BLACK);
 
             BeginMode2D(camera);
-                DrawGame(&game, &camera);
+                DrawGame(snapshot, &camera);
             EndMode2D();
             
             DrawFPS(0, 0);
-            if (selectedAgent) {
-                DrawAgentInfo(selectedAgent, (Vector2){0, 20});
+            DrawText(TextFormat("%.0f steps/s", stepsPerSecond), 100, 0, 20, LIME);
+            if (turbo) {
+                DrawText(TextFormat("TURBO %.0f ms", turboBudgetMs), 300, 0, 20, LIME);
+            }
+            if (snapshot->hasSelected) {
+                DrawAgentInfo(&snapshot->selected, (Vector2){0, 20});
             }
         EndDrawing();
     }
 
+    StopSimThread(&sim);
+    if (profilePath != NULL && !WriteProfileTrace(profilePath)) perror(profilePath);
     CloseWindow();
+    DestroyGame(game);
 
     return 0;
 }
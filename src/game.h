@@ -1,79 +1,58 @@
 #ifndef GAME_H_
 #define GAME_H_
 
-#include <stdbool.h>
+#include "sim.h"
+#include <stdatomic.h>
+#include <pthread.h>
 
 #define SCREEN_WIDTH  1280
 #define SCREEN_HEIGHT 720
 
-#define BOARD_WIDTH  200
-#define BOARD_HEIGHT 100
-
 #define CELL_SIZE 32
 
-#define GENES_COUNT 10
-#define HEALTH_MAX 100
-#define BEST_GENES_COUNT 50
-
-typedef enum {
-    DIR_LEFT = 0,
-    DIR_RIGHT,
-    DIR_UP,
-    DIR_DOWN,
-} Dir;
-
-typedef enum {
-    CONDITION_ALWAYS = 0,
-    CONDITION_FRONT_IS_FREE,
-    CONDITION_LEFT_IS_FREE,
-    CONDITION_RIGHT_IS_FREE,
-    CONDITION_FOOD_IN_FRONT,
-    CONDITION_FOOD_ON_LEFT,
-    CONDITION_FOOD_ON_RIGHT,
-    CONDITION_AGENT_IN_FRONT,
-    CONDITION_AGENT_ON_LEFT,
-    CONDITION_AGENT_ON_RIGHT,
-    CONDITION_WALL_IN_FRONT,
-    CONDITION_WALL_ON_LEFT,
-    CONDITION_WALL_ON_RIGHT,
-    CONDITION_COUNT,
-} Condition;
+// In turbo mode the simulation runs freely and publishes a snapshot at most
+// once per budget (T to toggle, [ and ] to adjust)
+#define TURBO_BUDGET_MS 14.0
 
 typedef enum {
-    ACTION_DO_NOTHING = 0,
-    ACTION_MOVE,
-    ACTION_ATTACK,
-    ACTION_EAT,
-    ACTION_TURN_LEFT,
-    ACTION_TURN_RIGHT,
-    ACTION_REPRODUCE,
-    ACTION_COUNT,
-} Action;
+    VIEW_EMPTY = 0,
+    VIEW_WALL,
+    VIEW_FOOD,
+    VIEW_AGENT, // VIEW_AGENT + Dir
+} ViewCell;
 
+// Immutable picture of the board published by the simulation thread
 typedef struct {
-    Condition cond;
-    Action action1; // if cond is true
-    int next1; // if cond is true
-    Action action2; // if cond is false
-    int next2; // if cond is false
-} Gene;
+    int width;
+    int height;
+    unsigned char *cells; // width*height
+    Agent selected; // copy of the selected agent
+    bool hasSelected;
+    long steps;
+} Snapshot;
+
+// Triple buffer: the writer fills its back buffer and swaps it with the
+// shared one, the reader swaps the shared one with its front buffer when
+// it is marked fresh. Neither side ever waits for the other.
+#define SNAPSHOT_FRESH 4
 
 typedef struct {
-    Gene genes[GENES_COUNT];
-    Dir dir;
-    int health;
-    int hunger;
-    int geneIndex;
-    bool wasUpdated;
-} Agent;
+    Snapshot buffers[3];
+    atomic_int shared; // buffer index | SNAPSHOT_FRESH
+    int back; // owned by the writer
+    int front; // owned by the reader
+} SnapshotBuffer;
 
 typedef struct {
-    Agent *agents[BOARD_HEIGHT][BOARD_WIDTH];
-    int foods[BOARD_HEIGHT][BOARD_WIDTH];
-    int walls[BOARD_HEIGHT][BOARD_WIDTH];
-    Gene bestGenes[BEST_GENES_COUNT][GENES_COUNT];
-    int bestGenesCount;
-    bool allDie;
-} Game;
+    Game *game;
+    SnapshotBuffer snapshots;
+    pthread_t thread;
+    atomic_bool running;
+    atomic_bool turbo;
+    atomic_int turboBudgetUs;
+    atomic_int pendingSteps;
+    atomic_int selectRequest; // cell index, -1 if none
+    atomic_long steps;
+} SimThread;
 
 #endif
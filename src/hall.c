@@ -0,0 +1,123 @@
+#include "hall.h"
+#include <string.h>
+
+uint32_t HallOfFameTableSize(int capacity) {
+    uint32_t size = 1;
+    while (size < 2u*capacity) size *= 2;
+    return size;
+}
+
+void InitHallOfFame(HallOfFame *hall, HallEntry *entries, void *genomes, int *positions, int *table,
+    int capacity, int genomeSize) {
+    *hall = (HallOfFame){
+        .entries = entries,
+        .genomes = genomes,
+        .positions = positions,
+        .table = table,
+        .tableMask = HallOfFameTableSize(capacity) - 1,
+        .genomeSize = genomeSize,
+        .capacity = capacity,
+    };
+    ClearHallOfFame(hall);
+}
+
+void ClearHallOfFame(HallOfFame *hall) {
+    hall->count = 0;
+    memset(hall->table, 0xff, (size_t)(hall->tableMask + 1)*sizeof(int));
+}
+
+static uint64_t SlotHash(const HallOfFame *hall, int slot) {
+    return hall->entries[hall->positions[slot]].hash;
+}
+
+// Returns the table bucket holding the genome with hash, or the empty
+// bucket where it would go
+static uint32_t FindBucket(const HallOfFame *hall, uint64_t hash) {
+    uint32_t b = hash & hall->tableMask;
+    while (hall->table[b] != HALL_SLOT_NONE && SlotHash(hall, hall->table[b]) != hash) {
+        b = (b + 1) & hall->tableMask;
+    }
+    return b;
+}
+
+// Empties bucket b and moves later entries of its probe run back into the
+// gap, so lookups never stop early at it
+static void RemoveBucket(HallOfFame *hall, uint32_t b) {
+    hall->table[b] = HALL_SLOT_NONE;
+    for (uint32_t j = (b + 1) & hall->tableMask; hall->table[j] != HALL_SLOT_NONE; j = (j + 1) & hall->tableMask) {
+        uint32_t home = SlotHash(hall, hall->table[j]) & hall->tableMask;
+        // Entries whose home lies cyclically in (b, j] are already reachable
+        if (((j - home) & hall->tableMask) < ((j - b) & hall->tableMask)) continue;
+        hall->table[b] = hall->table[j];
+        hall->table[j] = HALL_SLOT_NONE;
+        b = j;
+    }
+}
+
+static void PlaceEntry(HallOfFame *hall, int i, HallEntry entry) {
+    hall->entries[i] = entry;
+    hall->positions[entry.slot] = i;
+}
+
+static void SiftUp(HallOfFame *hall, int i) {
+    HallEntry entry = hall->entries[i];
+    while (i > 0) {
+        int parent = (i - 1)/2;
+        if (hall->entries[parent].fitness <= entry.fitness) break;
+        PlaceEntry(hall, i, hall->entries[parent]);
+        i = parent;
+    }
+    PlaceEntry(hall, i, entry);
+}
+
+static void SiftDown(HallOfFame *hall, int i) {
+    HallEntry entry = hall->entries[i];
+    for (;;) {
+        int child = 2*i + 1;
+        if (child >= hall->count) break;
+        if (child + 1 < hall->count && hall->entries[child + 1].fitness < hall->entries[child].fitness) child++;
+        if (entry.fitness <= hall->entries[child].fitness) break;
+        PlaceEntry(hall, i, hall->entries[child]);
+        i = child;
+    }
+    PlaceEntry(hall, i, entry);
+}
+
+bool OfferHallOfFame(HallOfFame *hall, const void *genome, uint64_t hash, long fitness) {
+    if (hall->capacity == 0) return false;
+    // A full hall rejects anything not fitter than its weakest entry, which
+    // also covers duplicates of entries at least that fit
+    if (hall->count == hall->capacity && fitness <= hall->entries[0].fitness) return false;
+
+    uint32_t b = FindBucket(hall, hash);
+    if (hall->table[b] != HALL_SLOT_NONE) {
+        int i = hall->positions[hall->table[b]];
+        if (fitness <= hall->entries[i].fitness) return false;
+        hall->entries[i].fitness = fitness;
+        SiftDown(hall, i);
+        return true;
+    }
+
+    HallEntry entry = {hash, fitness, hall->count};
+    if (hall->count == hall->capacity) {
+        // Replace the weakest
+        entry.slot = hall->entries[0].slot;
+        RemoveBucket(hall, FindBucket(hall, hall->entries[0].hash));
+        b = FindBucket(hall, hash);
+    }
+    memcpy(hall->genomes + (size_t)entry.slot*hall->genomeSize, genome, hall->genomeSize);
+    if (hall->count < hall->capacity) {
+        PlaceEntry(hall, hall->count, entry);
+        hall->table[b] = entry.slot;
+        SiftUp(hall, hall->count++);
+    } else {
+        PlaceEntry(hall, 0, entry);
+        hall->table[b] = entry.slot;
+        SiftDown(hall, 0);
+    }
+    return true;
+}
+
+void *GetHallOfFameGenome(const HallOfFame *hall, int i) {
+    return hall->genomes + (size_t)hall->entries[i].slot*hall->genomeSize;
+}
@@ -0,0 +1,41 @@
+#ifndef HALL_H_
+#define HALL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t hash; // genome content hash, one entry per genome
+    long fitness;
+    int slot; // genome storage slot, stays put while the entry moves in the heap
+} HallEntry;
+
+#define HALL_SLOT_NONE -1
+
+// Top-K genomes by fitness. A bounded min-heap: the weakest entry sits at
+// the root and is replaced when a fitter genome arrives. An open-addressing
+// table of genome slots by hash finds a genome already in the hall without
+// scanning it. The caller owns the storage; genomes are opaque blocks of
+// genomeSize bytes.
+typedef struct {
+    HallEntry *entries; // capacity
+    unsigned char *genomes; // capacity*genomeSize
+    int *positions; // capacity, heap index of the entry in every genome slot
+    int *table; // tableMask + 1 genome slots, HALL_SLOT_NONE when empty
+    uint32_t tableMask;
+    int genomeSize;
+    int count;
+    int capacity;
+} HallOfFame;
+
+// Entries of the slot table for a capacity, a power of two at most half full
+uint32_t HallOfFameTableSize(int capacity);
+void InitHallOfFame(HallOfFame *hall, HallEntry *entries, void *genomes, int *positions, int *table,
+    int capacity, int genomeSize);
+void ClearHallOfFame(HallOfFame *hall);
+// Adds a genome unless the hall is full of fitter ones. A genome already in
+// the hall keeps one entry with the better of both fitness values.
+bool OfferHallOfFame(HallOfFame *hall, const void *genome, uint64_t hash, long fitness);
+void *GetHallOfFameGenome(const HallOfFame *hall, int i);
+
+#endif
@@ -0,0 +1,83 @@
+#include "sim.h"
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void Usage(const char *name) {
+    fprintf(stderr, "usage: %s [--steps N] [--profile FILE] [options]\n"
+        "  --profile FILE    write a Chrome trace of the timing zones (make PROFILE=1)\n"
+        "%s", name, GameOptionsUsage());
+}
+
+int main(int argc, char **argv) {
+    GameConfig config = DefaultGameConfig();
+    long steps = 100000;
+    const char *profilePath = NULL;
+    for (int i = 1; i < argc;) {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = atol(argv[i + 1]);
+            i += 2;
+            continue;
+        }
+        if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profilePath = argv[i + 1];
+            i += 2;
+            continue;
+        }
+        int n = ParseGameOption(&config, argc, argv, i);
+        if (n <= 0) {
+            Usage(argv[0]);
+            return 1;
+        }
+        i += n;
+    }
+    if (profilePath != NULL && !PROFILE_ENABLED) {
+        fprintf(stderr, "--profile needs a build with timing zones, make clean && make PROFILE=1\n");
+        return 1;
+    }
+
+    Game *game = CreateGame(&config);
+    if (game == NULL) {
+        fprintf(stderr, "failed to allocate a %dx%d world\n", config.width, config.height);
+        return 1;
+    }
+    InitGame(game);
+    PROFILE_THREAD("main", -1);
+
+    long generations = 1;
+    double start = Now();
+    for (long i = 0; i < steps; i++) {
+        if (game->allDie) {
+            ReinitGame(game);
+            generations++;
+        }
+        StepGame(game);
+    }
+    double elapsed = Now() - start;
+
+    printf("board: %dx%d%s\n", game->width, game->height, game->powerOfTwo ? " (power of two)" : "");
+    printf("seed: %llu\n", (unsigned long long)game->seed);
+    printf("steps: %ld\n", steps);
+    printf("generations: %ld\n", generations);
+    printf("time: %.3f s\n", elapsed);
+    printf("steps/s: %.1f\n", steps/elapsed);
+    printf("agents: %d\n", game->agents.count);
+    printf("food cells: %d\n", CountFoodCells(game));
+    printf("walls: %d\n", CountWalls(game));
+    Pool *pool = &game->agents.genomePool;
+    printf("genome pool: %d live, %d high water, %d capacity\n", pool->live, pool->highWater, pool->capacity);
+    printf("species: %d\n", CountSpecies(game));
+
+    if (profilePath != NULL && !WriteProfileTrace(profilePath)) perror(profilePath);
+
+    DestroyGame(game);
+    return 0;
+}
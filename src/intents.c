@@ -0,0 +1,181 @@
+#include "intents.h"
+#include "workers.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CLAIM_NONE -1
+
+struct IntentEngine {
+    Game *game;
+    Workers workers;
+    int agentsCount; // agents deciding this step
+    SensorMask *sensors; // per agent, sensed on the start-of-step board
+    bool planeSensing;
+    Bitboard planes[SENSOR_PLANES]; // neighbour planes, with planeSensing
+    uint64_t *planeWords;
+
+    // One buffer per worker, bufferCapacity intents each
+    Intent *buffers;
+    int *bufferCounts;
+    int bufferCapacity;
+
+    Intent *intents; // all buffers in worker order
+    int intentsCount;
+    int *claims; // winning intent of every cell, moves and births
+    int *foodClaims; // winning intent of every cell, meals
+    int *dead;
+};
+
+IntentEngine *CreateIntentEngine(Game *game, int threads, bool planeSensing) {
+    IntentEngine *engine = calloc(1, sizeof(IntentEngine));
+    if (engine == NULL) return NULL;
+    engine->game = game;
+    InitWorkers(&engine->workers, threads);
+
+    int capacity = game->agents.capacity;
+    int workers = engine->workers.count;
+    engine->bufferCapacity = capacity/workers + 1;
+    engine->buffers = malloc((size_t)workers*engine->bufferCapacity*sizeof(Intent));
+    engine->bufferCounts = calloc(workers, sizeof(int));
+    engine->intents = malloc(capacity*sizeof(Intent));
+    engine->claims = malloc(game->cellsCount*sizeof(int));
+    engine->foodClaims = malloc(game->cellsCount*sizeof(int));
+    engine->dead = malloc(capacity*sizeof(int));
+    engine->sensors = malloc(capacity*sizeof(SensorMask));
+    if (!engine->sensors || !engine->buffers || !engine->bufferCounts || !engine->intents ||
+        !engine->claims || !engine->foodClaims || !engine->dead) {
+        DestroyIntentEngine(engine);
+        return NULL;
+    }
+    if (planeSensing) {
+        size_t words = BITBOARD_WORDS(game->cellsCount);
+        engine->planeWords = malloc(SENSOR_PLANES*words*sizeof(uint64_t));
+        if (engine->planeWords == NULL) {
+            DestroyIntentEngine(engine);
+            return NULL;
+        }
+        for (int p = 0; p < SENSOR_PLANES; p++) {
+            InitBitboard(&engine->planes[p], &engine->planeWords[p*words], game->cellsCount);
+        }
+        engine->planeSensing = true;
+    }
+    memset(engine->claims, 0xff, game->cellsCount*sizeof(int));
+    memset(engine->foodClaims, 0xff, game->cellsCount*sizeof(int));
+    return engine;
+}
+
+void DestroyIntentEngine(IntentEngine *engine) {
+    if (engine == NULL) return;
+    FreeWorkers(&engine->workers);
+    free(engine->buffers);
+    free(engine->bufferCounts);
+    free(engine->intents);
+    free(engine->claims);
+    free(engine->foodClaims);
+    free(engine->dead);
+    free(engine->sensors);
+    free(engine->planeWords);
+    free(engine);
+}
+
+// With planeSensing the sensors are filled before Decide, the planes split
+// between the workers and then the board by plane words
+static void ShiftPlanes(void *arg, int worker) {
+    PROFILE_ZONE("ShiftPlanes");
+    IntentEngine *engine = arg;
+    int workers = engine->workers.count;
+    ShiftSensorPlanes(engine->game, engine->planes, SENSOR_PLANES*worker/workers, SENSOR_PLANES*(worker + 1)/workers);
+}
+
+static void SensePlanes(void *arg, int worker) {
+    PROFILE_ZONE("SensePlanes");
+    IntentEngine *engine = arg;
+    int workers = engine->workers.count;
+    long words = engine->planes[0].wordsCount;
+    SenseAgentsFromPlanes(engine->game, engine->planes, (int)(words*worker/workers), (int)(words*(worker + 1)/workers), engine->sensors);
+}
+
+static void Decide(void *arg, int worker) {
+    PROFILE_ZONE("Decide");
+    IntentEngine *engine = arg;
+    int workers = engine->workers.count;
+    int from = (int)((long long)engine->agentsCount*worker/workers);
+    int to = (int)((long long)engine->agentsCount*(worker + 1)/workers);
+    Intent *buffer = &engine->buffers[(size_t)worker*engine->bufferCapacity];
+    if (!engine->planeSensing) SenseAgents(engine->game, from, to, engine->sensors);
+    engine->bufferCounts[worker] = DecideAgents(engine->game, from, to, engine->sensors, buffer);
+}
+
+static uint64_t Priority(IntentEngine *engine, int intent) {
+    Game *game = engine->game;
+    Rng rng;
+    KeyRng(&rng, game->seed, game->step, game->agents.cell[engine->intents[intent].agent], RNG_PURPOSE_CLAIM);
+    return NextRng(&rng);
+}
+
+static void Claim(IntentEngine *engine, int *claims, int intent) {
+    int *claim = &claims[engine->intents[intent].target];
+    if (*claim == CLAIM_NONE || Priority(engine, intent) > Priority(engine, *claim)) {
+        *claim = intent;
+    }
+}
+
+static void Resolve(IntentEngine *engine) {
+    PROFILE_ZONE("Resolve");
+    Game *game = engine->game;
+    Intent *intents = engine->intents;
+    int count = 0;
+    for (int w = 0; w < engine->workers.count; w++) {
+        memcpy(&intents[count], &engine->buffers[(size_t)w*engine->bufferCapacity], engine->bufferCounts[w]*sizeof(Intent));
+        count += engine->bufferCounts[w];
+    }
+
+    // Claims are taken before anything moves, priorities hash the start cells
+    for (int i = 0; i < count; i++) {
+        switch (intents[i].kind) {
+            case INTENT_MOVE:
+            case INTENT_REPRODUCE: Claim(engine, engine->claims, i); break;
+            case INTENT_EAT: Claim(engine, engine->foodClaims, i); break;
+            default: break;
+        }
+    }
+
+    StepContext ctx = {.dead = engine->dead};
+    for (int i = 0; i < count; i++) {
+        Intent *intent = &intents[i];
+        switch (intent->kind) {
+            case INTENT_MOVE:
+            case INTENT_REPRODUCE:
+                if (engine->claims[intent->target] != i) continue;
+                break;
+            case INTENT_EAT:
+                if (engine->foodClaims[intent->target] != i) continue;
+                break;
+            default: break;
+        }
+        ApplyIntent(game, &ctx, intent);
+    }
+
+    // Only the kinds that claimed a cell reset it; an attack's target is an
+    // agent index
+    for (int i = 0; i < count; i++) {
+        switch (intents[i].kind) {
+            case INTENT_MOVE:
+            case INTENT_REPRODUCE: engine->claims[intents[i].target] = CLAIM_NONE; break;
+            case INTENT_EAT: engine->foodClaims[intents[i].target] = CLAIM_NONE; break;
+            default: break;
+        }
+    }
+    BuryAgents(game, ctx.dead, ctx.deadCount);
+}
+
+void StepIntentEngine(IntentEngine *engine) {
+    engine->agentsCount = engine->game->agents.count;
+    if (engine->planeSensing) {
+        RunWorkers(&engine->workers, ShiftPlanes, engine);
+        RunWorkers(&engine->workers, SensePlanes, engine);
+    }
+    RunWorkers(&engine->workers, Decide, engine);
+    Resolve(engine);
+}
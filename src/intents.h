@@ -0,0 +1,21 @@
+#ifndef INTENTS_H_
+#define INTENTS_H_
+
+#include "sim.h"
+
+// Steps the world in two phases. Decide runs every agent against the board
+// as it was at the start of the step, split into equal ranges of the agent
+// store across a thread pool; each worker appends the agents' intents to
+// its own buffer. Resolve then walks the intents serially in store order.
+// Moves and births into the same cell, and meals from the same food cell,
+// are settled by a per-step hash of each claimant's cell, so no agent wins
+// by its position in the scan. Attacks always land.
+//
+// Results do not depend on the thread count, nor on planeSensing, which
+// senses every agent from twelve shifted bit planes in board order instead
+// of from the cells around it.
+IntentEngine *CreateIntentEngine(Game *game, int threads, bool planeSensing);
+void DestroyIntentEngine(IntentEngine *engine);
+void StepIntentEngine(IntentEngine *engine);
+
+#endif
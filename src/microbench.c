@@ -0,0 +1,275 @@
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MICROBENCH_SEED 1
+#define BATCH_CALLS 1024 // mutating calls between two board restores
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES_UNIT "cycles"
+// Time stamp counter, reference cycles at the nominal clock
+static inline uint64_t Cycles(void) {
+    return __rdtsc();
+}
+#else
+#define CYCLES_UNIT "ns"
+static inline uint64_t Cycles(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+#endif
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Keeps results of read-only calls alive
+static volatile long sink;
+
+typedef struct {
+    uint64_t cycles;
+    double seconds;
+    long calls;
+} Timing;
+
+static void Report(const char *name, Timing t) {
+    printf("%-40s %8.1f %s/call %8.2f ns/call\n", name, (double)t.cycles/t.calls, CYCLES_UNIT, t.seconds*1e9/t.calls);
+}
+
+// Agents on a density fraction of the cells, walls and food on the rest
+static void RandomizeBoard(Game *game, double density) {
+    Rng rng;
+    SeedRng(&rng, game->seed, 0);
+    uint32_t threshold = (uint32_t)(density*4294967295.0);
+    ClearGame(game);
+    for (int cell = 0; cell < game->cellsCount; cell++) {
+        if (NextRng32(&rng) < threshold) RandomAgent(game, cell);
+    }
+    CreateWallsAndFoods(game);
+}
+
+static int *RandomInts(Rng *rng, long count, int max) {
+    int *values = malloc(count*sizeof(int));
+    for (long i = 0; i < count; i++) values[i] = RngInt(rng, 0, max - 1);
+    return values;
+}
+
+static void BenchIsCellFree(Game *game, Rng *rng, long calls) {
+    int *cells = RandomInts(rng, calls, game->cellsCount);
+    long count = 0;
+    double start = Now();
+    uint64_t begin = Cycles();
+    for (long i = 0; i < calls; i++) count += IsCellFree(game, cells[i]);
+    Timing t = {Cycles() - begin, Now() - start, calls};
+    sink = count;
+    Report("IsCellFree", t);
+    free(cells);
+}
+
+static void BenchConditions(Game *game, Rng *rng, long calls) {
+    int *agents = RandomInts(rng, calls, game->agents.count);
+    for (Condition cond = 0; cond < CONDITION_COUNT; cond++) {
+        long taken = 0;
+        double start = Now();
+        uint64_t begin = Cycles();
+        for (long i = 0; i < calls; i++) taken += ExecuteCondition(game, agents[i], cond);
+        Timing t = {Cycles() - begin, Now() - start, calls};
+        sink = taken;
+        char name[64];
+        snprintf(name, sizeof(name), "ExecuteCondition %s", ConditionToStr(cond));
+        Report(name, t);
+    }
+    free(agents);
+}
+
+// Actions change the board, so they run on batches of agents, from the back
+// of the store like StepGame, and the board is restored between batches
+static void BenchActions(Game *game, const GameState *snapshot, long calls) {
+    for (Action action = 0; action < ACTION_COUNT; action++) {
+        Timing t = {0};
+        while (t.calls < calls) {
+            RestoreGameState(game, snapshot);
+            int batch = game->agents.count < BATCH_CALLS ? game->agents.count : BATCH_CALLS;
+            int last = game->agents.count - 1;
+            double start = Now();
+            uint64_t begin = Cycles();
+            for (int a = last; a > last - batch; a--) ExecuteAction(game, a, action);
+            t.cycles += Cycles() - begin;
+            t.seconds += Now() - start;
+            t.calls += batch;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "ExecuteAction %s", ActionToStr(action));
+        Report(name, t);
+    }
+    RestoreGameState(game, snapshot);
+}
+
+static void BenchPositions(Game *game, Rng *rng, long calls) {
+    // Coordinates one cell past each edge exercise the wrap around
+    Pos *positions = malloc(calls*sizeof(Pos));
+    Dir *dirs = malloc(calls*sizeof(Dir));
+    for (long i = 0; i < calls; i++) {
+        positions[i] = (Pos){RngInt(rng, -1, game->width), RngInt(rng, -1, game->height)};
+        dirs[i] = RandomDir(rng);
+    }
+
+    long sum = 0;
+    double start = Now();
+    uint64_t begin = Cycles();
+    for (long i = 0; i < calls; i++) {
+        Pos pos = ToBoardPos(game, positions[i]);
+        sum += pos.x + pos.y;
+    }
+    Timing t = {Cycles() - begin, Now() - start, calls};
+    Report("ToBoardPos", t);
+
+    start = Now();
+    begin = Cycles();
+    for (long i = 0; i < calls; i++) {
+        Pos pos = GetFrontPos(game, dirs[i], positions[i]);
+        sum += pos.x + pos.y;
+    }
+    t = (Timing){Cycles() - begin, Now() - start, calls};
+    Report("GetFrontPos", t);
+    sink = sum;
+    free(positions);
+    free(dirs);
+}
+
+// Births into free cells of the seeded board from random parents
+static void BenchReproduce(Game *game, const GameState *snapshot, Rng *rng, long calls) {
+    int *freeCells = malloc(game->cellsCount*sizeof(int));
+    int freeCount = 0;
+    for (int cell = 0; cell < game->cellsCount; cell++) {
+        if (IsCellFree(game, cell)) freeCells[freeCount++] = cell;
+    }
+    Timing t = {0};
+    while (freeCount > 0 && t.calls < calls) {
+        RestoreGameState(game, snapshot);
+        int batch = freeCount < BATCH_CALLS ? freeCount : BATCH_CALLS;
+        // Partial shuffle picks batch distinct free cells
+        for (int i = 0; i < batch; i++) {
+            int j = RngInt(rng, i, freeCount - 1);
+            int cell = freeCells[i];
+            freeCells[i] = freeCells[j];
+            freeCells[j] = cell;
+        }
+        int *parents = RandomInts(rng, batch, game->agents.count);
+        double start = Now();
+        uint64_t begin = Cycles();
+        for (int i = 0; i < batch; i++) ReproduceAgent(game, parents[i], freeCells[i]);
+        t.cycles += Cycles() - begin;
+        t.seconds += Now() - start;
+        t.calls += batch;
+        free(parents);
+    }
+    if (t.calls > 0) Report("ReproduceAgent", t);
+    RestoreGameState(game, snapshot);
+    free(freeCells);
+}
+
+// Senses every agent per pass, from the cells in store order and from the
+// shifted bit planes in board order; the plane pass includes the shifts
+static void BenchSensing(Game *game, long calls) {
+    SensorMask *sensors = malloc(game->agents.count*sizeof(SensorMask));
+    size_t words = BITBOARD_WORDS(game->cellsCount);
+    uint64_t *planeWords = malloc(SENSOR_PLANES*words*sizeof(uint64_t));
+    Bitboard planes[SENSOR_PLANES];
+    for (int p = 0; p < SENSOR_PLANES; p++) InitBitboard(&planes[p], &planeWords[p*words], game->cellsCount);
+    long passes = (calls + game->agents.count - 1)/game->agents.count;
+
+    double start = Now();
+    uint64_t begin = Cycles();
+    for (long i = 0; i < passes; i++) SenseAgents(game, 0, game->agents.count, sensors);
+    Timing t = {Cycles() - begin, Now() - start, passes*game->agents.count};
+    Report("SenseAgents", t);
+
+    start = Now();
+    begin = Cycles();
+    for (long i = 0; i < passes; i++) {
+        ShiftSensorPlanes(game, planes, 0, SENSOR_PLANES);
+        SenseAgentsFromPlanes(game, planes, 0, planes[0].wordsCount, sensors);
+    }
+    t = (Timing){Cycles() - begin, Now() - start, passes*game->agents.count};
+    Report("SenseAgentsFromPlanes with shifts", t);
+    sink = sensors[0];
+    free(planeWords);
+    free(sensors);
+}
+
+static void Usage(const char *name) {
+    fprintf(stderr, "usage: %s [--calls N] [--density P] [options]\n"
+        "  --calls N         calls per primitive (default: 1000000)\n"
+        "  --density P       fraction of cells seeded with agents (default: 0.25)\n"
+        "the seed defaults to %d\n%s", name, MICROBENCH_SEED, GameOptionsUsage());
+}
+
+int main(int argc, char **argv) {
+    GameConfig config = DefaultGameConfig();
+    config.seed = MICROBENCH_SEED;
+    long calls = 1000000;
+    double density = 0.25;
+    for (int i = 1; i < argc;) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = atol(argv[i + 1]);
+            i += 2;
+            continue;
+        }
+        if (strcmp(argv[i], "--density") == 0 && i + 1 < argc) {
+            density = atof(argv[i + 1]);
+            i += 2;
+            continue;
+        }
+        int n = ParseGameOption(&config, argc, argv, i);
+        if (n <= 0) {
+            Usage(argv[0]);
+            return 1;
+        }
+        i += n;
+    }
+    // The primitives run outside any step, engines play no part
+    config.engine = ENGINE_SERIAL;
+    if (calls <= 0 || density <= 0 || density > 1) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    Game *game = CreateGame(&config);
+    if (game == NULL) {
+        fprintf(stderr, "failed to allocate a %dx%d world\n", config.width, config.height);
+        return 1;
+    }
+    RandomizeBoard(game, density);
+    if (game->agents.count == 0) {
+        fprintf(stderr, "no agents on the board, raise --density\n");
+        return 1;
+    }
+    // Mutating primitives always start from the seeded board
+    GameState *snapshot = SaveGameState(game);
+    if (snapshot == NULL) {
+        fprintf(stderr, "failed to copy the world\n");
+        return 1;
+    }
+
+    printf("board: %dx%d%s, %d agents, seed %llu\n", game->width, game->height,
+        game->powerOfTwo ? " (power of two)" : "", game->agents.count, (unsigned long long)game->seed);
+    Rng rng;
+    SeedRng(&rng, game->seed, 1);
+    BenchIsCellFree(game, &rng, calls);
+    BenchPositions(game, &rng, calls);
+    BenchConditions(game, &rng, calls);
+    BenchSensing(game, calls);
+    BenchActions(game, snapshot, calls);
+    BenchReproduce(game, snapshot, &rng, calls);
+
+    FreeGameState(snapshot);
+    DestroyGame(game);
+    return 0;
+}
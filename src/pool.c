@@ -0,0 +1,42 @@
+#include "pool.h"
+
+void InitPool(Pool *pool, int *next, int capacity) {
+    pool->next = next;
+    pool->capacity = capacity;
+    pool->freeHead = POOL_NONE;
+    pool->freeTail = POOL_NONE;
+    pool->top = 0;
+    pool->live = 0;
+    pool->highWater = 0;
+    pool->acquired = 0;
+    pool->released = 0;
+}
+
+int AcquirePool(Pool *pool) {
+    int index;
+    if (pool->freeHead != POOL_NONE) {
+        index = pool->freeHead;
+        pool->freeHead = pool->next[index];
+        if (pool->freeHead == POOL_NONE) pool->freeTail = POOL_NONE;
+    } else if (pool->top < pool->capacity) {
+        index = pool->top++;
+    } else {
+        return POOL_NONE;
+    }
+    pool->live++;
+    if (pool->live > pool->highWater) pool->highWater = pool->live;
+    pool->acquired++;
+    return index;
+}
+
+void ReleasePool(Pool *pool, int index) {
+    pool->next[index] = POOL_NONE;
+    if (pool->freeTail == POOL_NONE) {
+        pool->freeHead = index;
+    } else {
+        pool->next[pool->freeTail] = index;
+    }
+    pool->freeTail = index;
+    pool->live--;
+    pool->released++;
+}
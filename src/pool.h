@@ -0,0 +1,27 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#define POOL_NONE -1
+
+// Fixed-capacity index allocator. Indices are handed out from a bump
+// pointer first and recycled through an intrusive free list afterwards,
+// both in O(1). The free list is a queue: the index released longest ago is
+// reused first, which spreads reuse over every free index. The caller owns
+// the storage the indices refer to.
+typedef struct {
+    int *next; // free list links, capacity entries
+    int capacity;
+    int freeHead;
+    int freeTail;
+    int top; // indices below top have been handed out at least once
+    int live;
+    int highWater;
+    long acquired;
+    long released;
+} Pool;
+
+void InitPool(Pool *pool, int *next, int capacity);
+int AcquirePool(Pool *pool);
+void ReleasePool(Pool *pool, int index);
+
+#endif
@@ -0,0 +1,113 @@
+#include "profile.h"
+#include <stdio.h>
+
+#ifdef PROFILE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    long arg;
+    uint64_t begin;
+    uint64_t end;
+} ProfileEvent;
+
+typedef struct ProfileRing {
+    ProfileEvent events[PROFILE_RING_EVENTS];
+    uint64_t written; // events ever recorded, events[written % PROFILE_RING_EVENTS] is next
+    char name[32];
+    int tid;
+    struct ProfileRing *next;
+} ProfileRing;
+
+// Rings are never freed, the trace can be written after their threads exit
+static pthread_mutex_t ringsLock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileRing *rings;
+static int ringsCount;
+static _Thread_local ProfileRing *threadRing;
+
+// Ticks and time when the first ring was made, the origin of the trace
+static uint64_t originTicks;
+static double originSeconds;
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static ProfileRing *GetThreadRing(void) {
+    if (threadRing != NULL) return threadRing;
+    ProfileRing *ring = calloc(1, sizeof(ProfileRing));
+    if (ring == NULL) return NULL;
+    pthread_mutex_lock(&ringsLock);
+    if (rings == NULL) {
+        originSeconds = Now();
+        originTicks = ProfileTicks();
+    }
+    ring->tid = ++ringsCount;
+    snprintf(ring->name, sizeof(ring->name), "thread %d", ring->tid);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&ringsLock);
+    threadRing = ring;
+    return ring;
+}
+
+void EndProfileZone(ProfileZone *zone) {
+    uint64_t end = ProfileTicks();
+    ProfileRing *ring = GetThreadRing();
+    if (ring == NULL) return;
+    ring->events[ring->written++ % PROFILE_RING_EVENTS] = (ProfileEvent){zone->name, zone->arg, zone->begin, end};
+}
+
+void NameProfileThread(const char *name, int index) {
+    ProfileRing *ring = GetThreadRing();
+    if (ring == NULL) return;
+    if (index >= 0) {
+        snprintf(ring->name, sizeof(ring->name), "%s %d", name, index);
+    } else {
+        snprintf(ring->name, sizeof(ring->name), "%s", name);
+    }
+}
+
+bool WriteProfileTrace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) return false;
+    pthread_mutex_lock(&ringsLock);
+    // Microseconds per tick, from the ticks and time elapsed since the origin
+    double scale = 0;
+    uint64_t ticks = ProfileTicks() - originTicks;
+    if (ticks > 0) scale = (Now() - originSeconds)*1e6/ticks;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    for (ProfileRing *ring = rings; ring != NULL; ring = ring->next) {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+            first ? "" : ",\n", ring->tid, ring->name);
+        first = false;
+        uint64_t from = (ring->written > PROFILE_RING_EVENTS) ? ring->written - PROFILE_RING_EVENTS : 0;
+        for (uint64_t i = from; i < ring->written; i++) {
+            const ProfileEvent *event = &ring->events[i % PROFILE_RING_EVENTS];
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                event->name, ring->tid, (double)(int64_t)(event->begin - originTicks)*scale,
+                (double)(event->end - event->begin)*scale);
+            if (event->arg != PROFILE_NO_ARG) fprintf(file, ", \"args\": {\"arg\": %ld}", event->arg);
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+    pthread_mutex_unlock(&ringsLock);
+    return fclose(file) == 0;
+}
+
+#else
+
+bool WriteProfileTrace(const char *path) {
+    (void)path;
+    return false;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Scoped timing zones. Built with -DPROFILE (make PROFILE=1) every zone
+// records its name, start and end into a ring of the calling thread, the
+// oldest events being overwritten; otherwise the macros compile to nothing.
+//
+//     PROFILE_ZONE("StepGame");          // until the end of the scope
+//     PROFILE_ZONE_ARG("tile", tile);    // with an integer shown as args.arg
+//     PROFILE_THREAD("worker", index);   // names the thread, -1 for no index
+
+#define PROFILE_RING_EVENTS (1 << 16) // per thread
+#define PROFILE_NO_ARG LONG_MIN
+
+typedef struct {
+    const char *name; // string literal
+    long arg;
+    uint64_t begin; // ProfileTicks
+} ProfileZone;
+
+#ifdef PROFILE
+
+#include <time.h>
+
+#define PROFILE_ENABLED 1
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+// Time stamp counter, converted to time when the trace is written
+static inline uint64_t ProfileTicks(void) {
+    return __rdtsc();
+}
+#else
+static inline uint64_t ProfileTicks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+#endif
+
+static inline ProfileZone BeginProfileZone(const char *name, long arg) {
+    return (ProfileZone){name, arg, ProfileTicks()};
+}
+
+void EndProfileZone(ProfileZone *zone);
+void NameProfileThread(const char *name, int index);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE_ARG(name, arg) \
+    ProfileZone PROFILE_CONCAT(profileZone, __LINE__) __attribute__((cleanup(EndProfileZone))) = \
+        BeginProfileZone(name, arg)
+#define PROFILE_ZONE(name) PROFILE_ZONE_ARG(name, PROFILE_NO_ARG)
+#define PROFILE_THREAD(name, index) NameProfileThread(name, index)
+
+#else
+
+#define PROFILE_ENABLED 0
+#define PROFILE_ZONE_ARG(name, arg) ((void)0)
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD(name, index) ((void)0)
+
+#endif
+
+// Writes the events still in every thread's ring as Chrome trace-event JSON
+// (chrome://tracing, Perfetto). Threads must not record while it runs.
+// Returns false when the file cannot be written or PROFILE is off.
+bool WriteProfileTrace(const char *path);
+
+#endif
@@ -0,0 +1,343 @@
+#include "reference.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Food saturates at the 13 bits a cell holds
+#define REFERENCE_FOOD_MAX 8191
+
+typedef struct {
+    bool wall;
+    int food;
+    int agent; // index into agents, -1 when empty
+} RefCell;
+
+typedef struct {
+    int x;
+    int y;
+    Dir dir;
+    int health;
+    int hunger;
+    int geneIndex;
+    Gene genes[GENES_COUNT_MAX];
+    long born;
+    int offspring;
+    int foodEaten;
+    int kills;
+} RefAgent;
+
+struct ReferenceWorld {
+    int width;
+    int height;
+    int genesCount;
+    uint64_t seed;
+    long step;
+    RefCell *cells; // y*width + x
+    RefAgent *agents; // update order, live agents in [0, count)
+    int count;
+    int capacity;
+};
+
+static RefCell *CellAt(const ReferenceWorld *world, int x, int y) {
+    x %= world->width;
+    if (x < 0) x += world->width;
+    y %= world->height;
+    if (y < 0) y += world->height;
+    return &world->cells[y*world->width + x];
+}
+
+// Cell next to agent a on one side: 0 front, 1 back, 2 left, 3 right
+static RefCell *NextTo(const ReferenceWorld *world, const RefAgent *a, int side) {
+    int dx = 0;
+    int dy = 0;
+    switch (a->dir) {
+        case DIR_UP: dy = -1; break;
+        case DIR_DOWN: dy = 1; break;
+        case DIR_LEFT: dx = -1; break;
+        case DIR_RIGHT: dx = 1; break;
+        default: break;
+    }
+    switch (side) {
+        case 0: return CellAt(world, a->x + dx, a->y + dy);
+        case 1: return CellAt(world, a->x - dx, a->y - dy);
+        // Left of a heading (dx, dy) on a y-down board is (dy, -dx)
+        case 2: return CellAt(world, a->x + dy, a->y - dx);
+        default: return CellAt(world, a->x - dy, a->y + dx);
+    }
+}
+
+static bool IsFree(const RefCell *cell) {
+    return !cell->wall && cell->agent < 0 && cell->food == 0;
+}
+
+static Dir RotateLeft(Dir dir) {
+    switch (dir) {
+        case DIR_UP: return DIR_LEFT;
+        case DIR_LEFT: return DIR_DOWN;
+        case DIR_DOWN: return DIR_RIGHT;
+        default: return DIR_UP;
+    }
+}
+
+static Dir RotateRight(Dir dir) {
+    return RotateLeft(RotateLeft(RotateLeft(dir)));
+}
+
+static void PutFood(RefCell *cell, int food) {
+    cell->food = (food > REFERENCE_FOOD_MAX) ? REFERENCE_FOOD_MAX : food;
+}
+
+// Leaves food behind and swaps the last agent into the dead one's place
+static void Die(ReferenceWorld *world, int a) {
+    RefAgent *agent = &world->agents[a];
+    RefCell *cell = CellAt(world, agent->x, agent->y);
+    PutFood(cell, (agent->hunger > 10) ? agent->hunger : 10);
+    cell->agent = -1;
+    int last = --world->count;
+    if (a != last) {
+        world->agents[a] = world->agents[last];
+        CellAt(world, world->agents[a].x, world->agents[a].y)->agent = a;
+    }
+}
+
+static void GiveBirth(ReferenceWorld *world, int a, RefCell *to) {
+    if (world->count == world->capacity) return;
+    int cellIndex = (int)(to - world->cells);
+    Rng rng;
+    KeyRng(&rng, world->seed, world->step, cellIndex, RNG_PURPOSE_MUTATION);
+    int last = world->genesCount - 1;
+    int geneIndex = RngInt(&rng, 0, last);
+    RefAgent child = world->agents[a];
+    for (int i = 0; i < world->genesCount; i++) {
+        // A gene mutates with odds 11 in 101, in one of its five fields
+        if (RngInt(&rng, 0, 100) > 10) continue;
+        Gene *gene = &child.genes[i];
+        switch (RngInt(&rng, 0, 4)) {
+            case 0: gene->cond = RngInt(&rng, 0, CONDITION_COUNT - 1); break;
+            case 1: gene->action1 = RngInt(&rng, 0, ACTION_COUNT - 1); break;
+            case 2: gene->action2 = RngInt(&rng, 0, ACTION_COUNT - 1); break;
+            case 3: gene->next1 = RngInt(&rng, 0, last); break;
+            case 4: gene->next2 = RngInt(&rng, 0, last); break;
+        }
+    }
+    RefAgent *parent = &world->agents[a];
+    child.x = cellIndex % world->width;
+    child.y = cellIndex / world->width;
+    child.dir = RotateLeft(RotateLeft(parent->dir));
+    child.hunger = parent->hunger/2;
+    child.health = parent->health;
+    child.geneIndex = geneIndex;
+    child.born = world->step;
+    child.offspring = 0;
+    child.foodEaten = 0;
+    child.kills = 0;
+    parent->hunger /= 2;
+    parent->offspring++;
+    world->agents[world->count] = child;
+    to->agent = world->count++;
+}
+
+static bool Sense(const ReferenceWorld *world, const RefAgent *a, Condition cond) {
+    switch (cond) {
+        case CONDITION_FRONT_IS_FREE: return IsFree(NextTo(world, a, 0));
+        case CONDITION_LEFT_IS_FREE: return IsFree(NextTo(world, a, 2));
+        case CONDITION_RIGHT_IS_FREE: return IsFree(NextTo(world, a, 3));
+        case CONDITION_FOOD_IN_FRONT: return NextTo(world, a, 0)->food > 0;
+        case CONDITION_FOOD_ON_LEFT: return NextTo(world, a, 2)->food > 0;
+        case CONDITION_FOOD_ON_RIGHT: return NextTo(world, a, 3)->food > 0;
+        case CONDITION_AGENT_IN_FRONT: return NextTo(world, a, 0)->agent >= 0;
+        case CONDITION_AGENT_ON_LEFT: return NextTo(world, a, 2)->agent >= 0;
+        case CONDITION_AGENT_ON_RIGHT: return NextTo(world, a, 3)->agent >= 0;
+        case CONDITION_WALL_IN_FRONT: return NextTo(world, a, 0)->wall;
+        case CONDITION_WALL_ON_LEFT: return NextTo(world, a, 2)->wall;
+        case CONDITION_WALL_ON_RIGHT: return NextTo(world, a, 3)->wall;
+        default: return true;
+    }
+}
+
+static void Act(ReferenceWorld *world, int a, Action action) {
+    RefAgent *agent = &world->agents[a];
+    RefCell *front = NextTo(world, agent, 0);
+    switch (action) {
+        case ACTION_MOVE:
+            if (IsFree(front)) {
+                CellAt(world, agent->x, agent->y)->agent = -1;
+                front->agent = a;
+                int cellIndex = (int)(front - world->cells);
+                agent->x = cellIndex % world->width;
+                agent->y = cellIndex / world->width;
+            }
+            break;
+        case ACTION_TURN_LEFT: agent->dir = RotateLeft(agent->dir); break;
+        case ACTION_TURN_RIGHT: agent->dir = RotateRight(agent->dir); break;
+        case ACTION_ATTACK:
+            if (front->agent >= 0) {
+                RefAgent *target = &world->agents[front->agent];
+                target->health -= 10;
+                // The original rule removes the attacker
+                if (target->health <= 0) {
+                    agent->kills++;
+                    Die(world, a);
+                }
+            }
+            break;
+        case ACTION_EAT:
+            agent->hunger += front->food;
+            agent->foodEaten += front->food;
+            front->food = 0;
+            break;
+        case ACTION_REPRODUCE: {
+            RefCell *back = NextTo(world, agent, 1);
+            if (IsFree(back)) GiveBirth(world, a, back);
+        } break;
+        default: break;
+    }
+}
+
+void StepReferenceWorld(ReferenceWorld *world) {
+    // From the back: births land behind the cursor and a dead agent is
+    // replaced by one that already ran
+    for (int a = world->count - 1; a >= 0; a--) {
+        RefAgent *agent = &world->agents[a];
+        agent->hunger -= 5;
+        if (agent->hunger < 0) {
+            agent->hunger = 0;
+            agent->health -= 10;
+            if (agent->health <= 0) {
+                Die(world, a);
+                continue;
+            }
+        }
+        Gene gene = agent->genes[agent->geneIndex];
+        if (Sense(world, agent, gene.cond)) {
+            agent->geneIndex = gene.next1;
+            Act(world, a, gene.action1);
+        } else {
+            agent->geneIndex = gene.next2;
+            Act(world, a, gene.action2);
+        }
+    }
+    world->step++;
+}
+
+// Reads one agent of game's store in the reference form
+static RefAgent ReadAgent(const Game *game, int a) {
+    const Agents *agents = &game->agents;
+    const PackedGene *genes = &agents->genomes[(size_t)agents->genome[a]*game->genesCount];
+    RefAgent agent = {
+        .x = agents->cell[a] % game->width,
+        .y = agents->cell[a] / game->width,
+        .dir = agents->dir[a],
+        .health = agents->health[a],
+        .hunger = agents->hunger[a],
+        .geneIndex = agents->geneIndex[a],
+        .born = agents->born[a],
+        .offspring = agents->offspring[a],
+        .foodEaten = agents->foodEaten[a],
+        .kills = agents->kills[a],
+    };
+    for (int i = 0; i < game->genesCount; i++) agent.genes[i] = UnpackGene(genes[i]);
+    return agent;
+}
+
+static RefCell ReadCell(const Game *game, int cell) {
+    return (RefCell){
+        .wall = (game->cells[cell] & CELL_WALL) != 0,
+        .food = CELL_FOOD(game->cells[cell]),
+        .agent = -1,
+    };
+}
+
+ReferenceWorld *CreateReferenceWorld(const Game *game) {
+    ReferenceWorld *world = calloc(1, sizeof(ReferenceWorld));
+    if (world == NULL) return NULL;
+    world->width = game->width;
+    world->height = game->height;
+    world->genesCount = game->genesCount;
+    world->seed = game->seed;
+    world->step = game->step;
+    world->capacity = game->agents.capacity;
+    world->cells = malloc((size_t)game->cellsCount*sizeof(RefCell));
+    world->agents = malloc((size_t)world->capacity*sizeof(RefAgent));
+    if (world->cells == NULL || world->agents == NULL) {
+        DestroyReferenceWorld(world);
+        return NULL;
+    }
+    for (int cell = 0; cell < game->cellsCount; cell++) world->cells[cell] = ReadCell(game, cell);
+    world->count = game->agents.count;
+    for (int a = 0; a < world->count; a++) {
+        world->agents[a] = ReadAgent(game, a);
+        world->cells[game->agents.cell[a]].agent = a;
+    }
+    return world;
+}
+
+void DestroyReferenceWorld(ReferenceWorld *world) {
+    if (world == NULL) return;
+    free(world->cells);
+    free(world->agents);
+    free(world);
+}
+
+static bool SameGenes(const ReferenceWorld *world, const RefAgent *a, const RefAgent *b) {
+    for (int i = 0; i < world->genesCount; i++) {
+        const Gene *x = &a->genes[i];
+        const Gene *y = &b->genes[i];
+        if (x->cond != y->cond || x->action1 != y->action1 || x->next1 != y->next1 ||
+            x->action2 != y->action2 || x->next2 != y->next2) return false;
+    }
+    return true;
+}
+
+static void DescribeAgent(const RefAgent *a, char *out, size_t size) {
+    snprintf(out, size, "agent at %d,%d %s health %d hunger %d gene %d born %ld offspring %d food %d kills %d",
+        a->x, a->y, DirToStr(a->dir), a->health, a->hunger, a->geneIndex, a->born, a->offspring,
+        a->foodEaten, a->kills);
+}
+
+int DiffReferenceWorld(const ReferenceWorld *world, const Game *game, FILE *out, int maxReported) {
+    if (out == NULL) maxReported = 0;
+    if (world->width != game->width || world->height != game->height) {
+        if (out != NULL) fprintf(out, "  boards differ in size\n");
+        return 1;
+    }
+    int differing = 0;
+    if (world->step != game->step) {
+        if (differing++ < maxReported) fprintf(out, "  step: reference %ld, candidate %ld\n", world->step, game->step);
+    }
+    for (int cell = 0; cell < game->cellsCount; cell++) {
+        RefCell expected = world->cells[cell];
+        RefCell actual = ReadCell(game, cell);
+        bool hasAgent = (game->cells[cell] & CELL_AGENT) != 0;
+        if (expected.wall == actual.wall && expected.food == actual.food && (expected.agent >= 0) == hasAgent) continue;
+        if (differing++ < maxReported) {
+            fprintf(out, "  %d,%d\n    reference: wall %d food %d agent %d\n    candidate: wall %d food %d agent %d\n",
+                cell % game->width, cell / game->width, expected.wall, expected.food, expected.agent >= 0,
+                actual.wall, actual.food, hasAgent);
+        }
+    }
+    if (world->count != game->agents.count) {
+        if (differing++ < maxReported) {
+            fprintf(out, "  agents: reference %d, candidate %d\n", world->count, game->agents.count);
+        }
+    }
+    int count = (world->count < game->agents.count) ? world->count : game->agents.count;
+    for (int a = 0; a < count; a++) {
+        RefAgent expected = world->agents[a];
+        RefAgent actual = ReadAgent(game, a);
+        if (expected.x == actual.x && expected.y == actual.y && expected.dir == actual.dir &&
+            expected.health == actual.health && expected.hunger == actual.hunger &&
+            expected.geneIndex == actual.geneIndex && expected.born == actual.born &&
+            expected.offspring == actual.offspring && expected.foodEaten == actual.foodEaten &&
+            expected.kills == actual.kills && SameGenes(world, &expected, &actual)) continue;
+        if (differing++ < maxReported) {
+            char a1[256];
+            char a2[256];
+            DescribeAgent(&expected, a1, sizeof(a1));
+            DescribeAgent(&actual, a2, sizeof(a2));
+            fprintf(out, "  agent %d%s\n    reference: %s\n    candidate: %s\n", a,
+                SameGenes(world, &expected, &actual) ? "" : ", genes differ", a1, a2);
+        }
+    }
+    if (out != NULL && differing > maxReported) fprintf(out, "  ... %d differences\n", differing);
+    return differing;
+}
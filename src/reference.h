@@ -0,0 +1,26 @@
+#ifndef REFERENCE_H_
+#define REFERENCE_H_
+
+#include "sim.h"
+#include <stdio.h>
+
+// Frozen reference of the serial engine's step rules: hunger, genes,
+// moving, turning, attacking, eating, births with mutation, deaths and the
+// back-to-front update order. It runs on its own plain board and agent
+// arrays and shares no code with the engines, only the gene vocabulary,
+// the random streams and the world setup (InitGame, ReinitGame), which it
+// copies from a Game. The serial engine must evolve identically; live-trace
+// soak checks that. Keep it simple and leave it alone unless the rules
+// themselves change.
+typedef struct ReferenceWorld ReferenceWorld;
+
+// Copies the board, agents and step of game, NULL if out of memory
+ReferenceWorld *CreateReferenceWorld(const Game *game);
+void DestroyReferenceWorld(ReferenceWorld *world);
+void StepReferenceWorld(ReferenceWorld *world);
+// Compares the world with game cell by cell and agent by agent, store order
+// included, and returns how many things differ; the first maxReported are
+// described on out, which may be NULL to only count them
+int DiffReferenceWorld(const ReferenceWorld *world, const Game *game, FILE *out, int maxReported);
+
+#endif
@@ -0,0 +1,25 @@
+#include "rng.h"
+
+static void InitRng(Rng *rng, uint64_t seed, uint32_t c1, uint32_t c2, uint32_t c3) {
+    *rng = (Rng){
+        .key = {(uint32_t)seed, (uint32_t)(seed >> 32)},
+        .counter = {0, c1, c2, c3},
+        .used = 4,
+    };
+}
+
+void SeedRng(Rng *rng, uint64_t seed, uint64_t stream) {
+    InitRng(rng, seed, (uint32_t)stream, (uint32_t)(stream >> 32) & 0xffffff, RNG_PURPOSE_STREAM << 24);
+}
+
+void KeyRng(Rng *rng, uint64_t seed, uint64_t step, uint32_t cell, uint32_t purpose) {
+    InitRng(rng, seed, cell, (uint32_t)step, ((uint32_t)(step >> 32) & 0xffffff) | (purpose << 24));
+}
+
+// Derives a child stream, advancing the parent
+Rng SplitRng(Rng *rng) {
+    Rng child;
+    uint64_t seed = NextRng(rng);
+    SeedRng(&child, seed, NextRng(rng) >> 8);
+    return child;
+}
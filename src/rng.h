@@ -0,0 +1,78 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <stdint.h>
+
+// Philox4x32-10 counter-based generator. Every output block is a pure
+// function of a 64-bit key (the run seed) and a 128-bit counter, so draws
+// need no shared state: a stream keyed by (seed, step, cell, purpose) yields
+// the same numbers whichever thread or engine asks for them.
+//
+// counter[0] counts blocks within a stream (2^32 blocks of four words).
+// counter[1..3] name the stream: (cell, step, purpose) for KeyRng, a 64-bit
+// stream id with purpose 0 for SeedRng.
+typedef struct {
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    int used; // words of block already returned
+} Rng;
+
+#define RNG_PURPOSE_STREAM 0
+
+static inline void PhiloxRng(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)0xd2511f53u*c0;
+        uint64_t p1 = (uint64_t)0xcd9e8d57u*c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9e3779b9u;
+        k1 += 0xbb67ae85u;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// Sequential stream, stream ids must stay below 2^56
+void SeedRng(Rng *rng, uint64_t seed, uint64_t stream);
+// Stream of the draws one cell makes for one purpose during one step.
+// purpose is 1..255, step must stay below 2^56.
+void KeyRng(Rng *rng, uint64_t seed, uint64_t step, uint32_t cell, uint32_t purpose);
+Rng SplitRng(Rng *rng);
+
+static inline uint32_t NextRng32(Rng *rng) {
+    if (rng->used == 4) {
+        PhiloxRng(rng->counter, rng->key, rng->block);
+        rng->counter[0]++;
+        rng->used = 0;
+    }
+    return rng->block[rng->used++];
+}
+
+static inline uint64_t NextRng(Rng *rng) {
+    uint64_t hi = NextRng32(rng);
+    return (hi << 32) | NextRng32(rng);
+}
+
+// Uniform integer in [min, max] (Lemire's multiply-shift with rejection)
+static inline int RngInt(Rng *rng, int min, int max) {
+    uint32_t range = (uint32_t)(max - min) + 1;
+    uint64_t m = (uint64_t)NextRng32(rng)*range;
+    if ((uint32_t)m < range) {
+        uint32_t threshold = -range % range;
+        while ((uint32_t)m < threshold) {
+            m = (uint64_t)NextRng32(rng)*range;
+        }
+    }
+    return min + (int)(m >> 32);
+}
+
+#endif
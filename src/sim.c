@@ -0,0 +1,1502 @@
+#include "sim.h"
+#include "tiles.h"
+#include "intents.h"
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+// Draws are keyed by the seed, the step and the cell, so a world is
+// reproducible from its seed
+void SeedGame(Game *game, uint64_t seed) {
+    game->seed = seed;
+}
+
+static inline Rng CellRng(const Game *game, int cell, int purpose) {
+    Rng rng;
+    KeyRng(&rng, game->seed, game->step, cell, purpose);
+    return rng;
+}
+
+char *DirToStr(Dir dir) {
+    switch (dir) {
+        case DIR_UP: return "DIR_UP";
+        case DIR_LEFT: return "DIR_LEFT";
+        case DIR_DOWN: return "DIR_DOWN";
+        case DIR_RIGHT: return "DIR_RIGHT";
+        default: return "";
+    }
+}
+
+char *ConditionToStr(Condition cond) {
+    switch (cond) {
+        case CONDITION_ALWAYS: return "CONDITION_ALWAYS";
+        case CONDITION_LEFT_IS_FREE: return "CONDITION_LEFT_IS_FREE";
+        case CONDITION_RIGHT_IS_FREE: return "CONDITION_RIGHT_IS_FREE";
+        case CONDITION_FRONT_IS_FREE: return "CONDITION_FRONT_IS_FREE";
+        case CONDITION_FOOD_IN_FRONT: return "CONDITION_FOOD_IN_FRONT";
+        case CONDITION_FOOD_ON_LEFT: return "CONDITION_FOOD_ON_LEFT";
+        case CONDITION_FOOD_ON_RIGHT: return "CONDITION_FOOD_ON_RIGHT";
+        case CONDITION_AGENT_IN_FRONT: return "CONDITION_AGENT_IN_FRONT";
+        case CONDITION_AGENT_ON_LEFT: return "CONDITION_AGENT_ON_LEFT";
+        case CONDITION_AGENT_ON_RIGHT: return "CONDITION_AGENT_ON_RIGHT";
+        case CONDITION_WALL_IN_FRONT: return "CONDITION_WALL_IN_FRONT";
+        case CONDITION_WALL_ON_LEFT: return "CONDITION_WALL_ON_LEFT";
+        case CONDITION_WALL_ON_RIGHT: return "CONDITION_WALL_ON_RIGHT";
+        default: return "";
+    }
+}
+
+char *ActionToStr(Action action) {
+    switch (action) {
+        case ACTION_MOVE: return "ACTION_MOVE";
+        case ACTION_ATTACK: return "ACTION_ATTACK";
+        case ACTION_EAT: return "ACTION_EAT";
+        case ACTION_DO_NOTHING: return "ACTION_DO_NOTHING";
+        case ACTION_TURN_LEFT: return "ACTION_TURN_LEFT";
+        case ACTION_TURN_RIGHT: return "ACTION_TURN_RIGHT";
+        case ACTION_REPRODUCE: return "ACTION_REPRODUCE";
+        default: return "";
+    }
+}
+
+GameConfig DefaultGameConfig(void) {
+    return (GameConfig){
+        .width = BOARD_WIDTH,
+        .height = BOARD_HEIGHT,
+        .genesCount = GENES_COUNT,
+        .bestGenesCount = BEST_GENES_COUNT,
+        .hallOfFameCount = HALL_OF_FAME_COUNT,
+        .fitness = {.age = 1, .offspring = 10},
+        .hugePages = false,
+        .seed = (uint64_t)time(NULL),
+        .engine = ENGINE_SERIAL,
+        .threads = 1,
+        .tileSize = TILE_SIZE,
+        .planeSensing = false,
+    };
+}
+
+static bool ParseInt(const char *value, int min, int max, int *out) {
+    char *end;
+    long v = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || v < min || v > max) return false;
+    *out = v;
+    return true;
+}
+
+// "metric:weight,..." with metrics age, offspring, food and kills. Metrics
+// left out weigh 0.
+static bool ParseFitness(const char *value, Fitness *out) {
+    Fitness fitness = {0};
+    char buffer[256];
+    if (strlen(value) >= sizeof(buffer)) return false;
+    strcpy(buffer, value);
+    for (char *item = strtok(buffer, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *colon = strchr(item, ':');
+        if (colon == NULL) return false;
+        *colon = '\0';
+        int *weight = NULL;
+        if (strcmp(item, "age") == 0) weight = &fitness.age;
+        else if (strcmp(item, "offspring") == 0) weight = &fitness.offspring;
+        else if (strcmp(item, "food") == 0) weight = &fitness.food;
+        else if (strcmp(item, "kills") == 0) weight = &fitness.kills;
+        if (weight == NULL || !ParseInt(colon + 1, -1000000, 1000000, weight)) return false;
+    }
+    *out = fitness;
+    return true;
+}
+
+bool SetGameConfigValue(GameConfig *config, const char *key, const char *value) {
+    if (strcmp(key, "width") == 0) return ParseInt(value, 1, 1 << 16, &config->width);
+    if (strcmp(key, "height") == 0) return ParseInt(value, 1, 1 << 16, &config->height);
+    if (strcmp(key, "genes") == 0) return ParseInt(value, 1, GENES_COUNT_MAX, &config->genesCount);
+    if (strcmp(key, "best-genes") == 0) return ParseInt(value, 1, 1 << 24, &config->bestGenesCount);
+    if (strcmp(key, "hall-of-fame") == 0) return ParseInt(value, 0, 1 << 20, &config->hallOfFameCount);
+    if (strcmp(key, "fitness") == 0) return ParseFitness(value, &config->fitness);
+    if (strcmp(key, "seed") == 0) {
+        char *end;
+        unsigned long long v = strtoull(value, &end, 0);
+        if (end == value || *end != '\0') return false;
+        config->seed = v;
+        return true;
+    }
+    if (strcmp(key, "engine") == 0) {
+        for (Engine engine = 0; engine < ENGINE_COUNT; engine++) {
+            if (strcmp(value, GetEngineOps(engine)->name) == 0) {
+                config->engine = engine;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (strcmp(key, "threads") == 0) return ParseInt(value, 1, THREADS_MAX, &config->threads);
+    if (strcmp(key, "tile-size") == 0) return ParseInt(value, 2, 1 << 16, &config->tileSize);
+    if (strcmp(key, "huge-pages") == 0) {
+        int v;
+        if (!ParseInt(value, 0, 1, &v)) return false;
+        config->hugePages = v;
+        return true;
+    }
+    if (strcmp(key, "plane-sensing") == 0) {
+        int v;
+        if (!ParseInt(value, 0, 1, &v)) return false;
+        config->planeSensing = v;
+        return true;
+    }
+    return false;
+}
+
+// Reads "key = value" lines, '#' starts a comment
+bool LoadGameConfig(GameConfig *config, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+    char line[256];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        char key[64], value[64];
+        int n = sscanf(line, " %63[^= \t] = %63s", key, value);
+        if (n == EOF || n == 0) continue;
+        ok = n == 2 && SetGameConfigValue(config, key, value);
+    }
+    fclose(f);
+    return ok;
+}
+
+// Parses the option at argv[i]. Returns the number of arguments consumed,
+// 0 if argv[i] is not a game option and -1 if its value is invalid.
+int ParseGameOption(GameConfig *config, int argc, char **argv, int i) {
+    const char *arg = argv[i];
+    if (strncmp(arg, "--", 2) != 0) return 0;
+    if (strcmp(arg, "--huge-pages") == 0) {
+        config->hugePages = true;
+        return 1;
+    }
+    if (strcmp(arg, "--plane-sensing") == 0) {
+        config->planeSensing = true;
+        return 1;
+    }
+    if (strcmp(arg, "--config") == 0) {
+        if (i + 1 >= argc) return -1;
+        return LoadGameConfig(config, argv[i + 1]) ? 2 : -1;
+    }
+    const char *keys[] = {"width", "height", "genes", "best-genes", "hall-of-fame", "fitness", "seed", "engine", "threads", "tile-size"};
+    for (size_t k = 0; k < sizeof(keys)/sizeof(keys[0]); k++) {
+        if (strcmp(arg + 2, keys[k]) == 0) {
+            if (i + 1 >= argc) return -1;
+            return SetGameConfigValue(config, keys[k], argv[i + 1]) ? 2 : -1;
+        }
+    }
+    return 0;
+}
+
+const char *GameOptionsUsage(void) {
+    return
+        "  --width N         board width (default 200)\n"
+        "  --height N        board height (default 100)\n"
+        "  --genes N         genes per genome (default 10, max 64)\n"
+        "  --best-genes N    archived genomes used by ReinitGame (default 50)\n"
+        "  --hall-of-fame N  fittest genomes kept for ReinitGame, 0 to disable (default 50)\n"
+        "  --fitness SPEC    metric weights, e.g. age:1,offspring:10 (default);\n"
+        "                    metrics are age, offspring, food and kills\n"
+        "  --seed N          seed of the world random stream (default: current time)\n"
+        "  --engine NAME     serial (default), tiles or intents\n"
+        "  --threads N       worker threads of the tiles and intents engines (default 1)\n"
+        "  --tile-size N     target tile size of the tiles engine (default 32)\n"
+        "  --huge-pages      back the world with huge pages when available\n"
+        "  --plane-sensing   intents engine senses from shifted bit planes (slower, see README)\n"
+        "  --config FILE     read the options above from FILE as key = value lines\n";
+}
+
+static bool IsPowerOfTwo(int n) {
+    return (n & (n - 1)) == 0;
+}
+
+static size_t AlignSize(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+// Anonymous mappings are zeroed and committed lazily. Arrays sized for the
+// worst case only cost memory for the part that is actually touched.
+// Explicit huge pages are tried first. They must be reserved up front, so
+// the mapping fails cleanly when there are not enough. Otherwise
+// transparent huge pages are requested for a regular mapping.
+static void *MapWorld(size_t *size, bool hugePages) {
+    void *memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugePages) {
+        size_t huge = (*size + (2 << 20) - 1) & ~(size_t)((2 << 20) - 1);
+        memory = mmap(NULL, huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            *size = huge;
+            return memory;
+        }
+    }
+#endif
+    memory = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (hugePages) madvise(memory, *size, MADV_HUGEPAGE);
+#endif
+    return memory;
+}
+
+static void InitNeighbors(Game *game) {
+    int dx[4] = {[DIR_LEFT] = -1, [DIR_RIGHT] = 1, [DIR_UP] = 0, [DIR_DOWN] = 0};
+    int dy[4] = {[DIR_LEFT] = 0, [DIR_RIGHT] = 0, [DIR_UP] = -1, [DIR_DOWN] = 1};
+    for (int dir = 0; dir < 4; dir++) {
+        Dir sides[SIDE_COUNT] = {
+            [SIDE_FRONT] = dir,
+            [SIDE_BACK] = GetReverseDir(dir),
+            [SIDE_LEFT] = TurnLeft(dir),
+            [SIDE_RIGHT] = TurnRight(dir),
+        };
+        for (int side = 0; side < SIDE_COUNT; side++) {
+            game->neighborDx[dir][side] = dx[sides[side]];
+            game->neighborDy[dir][side] = dy[sides[side]]*game->width;
+            game->neighborOffsets[dir][side] = game->neighborDx[dir][side] + game->neighborDy[dir][side];
+        }
+    }
+}
+
+Game *CreateGame(const GameConfig *config) {
+    long long cellsCount = (long long)config->width*config->height;
+    if (cellsCount > (1 << 30)) return NULL;
+
+    Game *game = calloc(1, sizeof(Game));
+    if (game == NULL) return NULL;
+    game->width = config->width;
+    game->height = config->height;
+    game->cellsCount = cellsCount;
+    game->genesCount = config->genesCount;
+    game->bestGenesMax = config->bestGenesCount;
+    game->fitness = config->fitness;
+    game->powerOfTwo = IsPowerOfTwo(game->width) && IsPowerOfTwo(game->height);
+    game->widthMask = game->width - 1;
+    game->cellsMask = game->cellsCount - 1;
+    InitNeighbors(game);
+
+    Agents *agents = &game->agents;
+    agents->capacity = (cellsCount < AGENTS_CAPACITY_MAX) ? cellsCount : AGENTS_CAPACITY_MAX;
+    agents->slotBits = 1;
+    while ((1 << agents->slotBits) < agents->capacity) agents->slotBits++;
+    agents->slotMask = ((AgentHandle)1 << agents->slotBits) - 1;
+    // At most half full
+    uint32_t tableSize = 1;
+    while (tableSize < 2u*agents->capacity) tableSize *= 2;
+    agents->genomeTableMask = tableSize - 1;
+
+    size_t n = game->cellsCount;
+    size_t a = agents->capacity;
+    struct { void **ptr; size_t size; } arrays[] = {
+        {(void **)&game->grid, n*sizeof(AgentHandle)},
+        {(void **)&game->cells, n*sizeof(Cell)},
+        {(void **)&game->wallBits.words, BITBOARD_WORDS(n)*sizeof(uint64_t)},
+        {(void **)&game->foodBits.words, BITBOARD_WORDS(n)*sizeof(uint64_t)},
+        {(void **)&game->agentBits.words, BITBOARD_WORDS(n)*sizeof(uint64_t)},
+        {(void **)&game->bestGenes, (size_t)game->bestGenesMax*game->genesCount*sizeof(PackedGene)},
+        {(void **)&game->hall.entries, (size_t)config->hallOfFameCount*sizeof(HallEntry)},
+        {(void **)&game->hall.genomes, (size_t)config->hallOfFameCount*game->genesCount*sizeof(PackedGene)},
+        {(void **)&game->hall.positions, (size_t)config->hallOfFameCount*sizeof(int)},
+        {(void **)&game->hall.table, (size_t)HallOfFameTableSize(config->hallOfFameCount)*sizeof(int)},
+        {(void **)&agents->dir, a*sizeof(Dir)},
+        {(void **)&agents->health, a*sizeof(int)},
+        {(void **)&agents->hunger, a*sizeof(int)},
+        {(void **)&agents->geneIndex, a*sizeof(int)},
+        {(void **)&agents->cell, a*sizeof(int)},
+        {(void **)&agents->genome, a*sizeof(int)},
+        {(void **)&agents->born, a*sizeof(long)},
+        {(void **)&agents->offspring, a*sizeof(int)},
+        {(void **)&agents->foodEaten, a*sizeof(int)},
+        {(void **)&agents->kills, a*sizeof(int)},
+        {(void **)&agents->handle, a*sizeof(AgentHandle)},
+        {(void **)&agents->slotAgent, a*sizeof(int)},
+        {(void **)&agents->slotGeneration, a*sizeof(uint32_t)},
+        {(void **)&agents->slotsNext, a*sizeof(int)},
+        {(void **)&agents->genomes, a*game->genesCount*sizeof(PackedGene)},
+        {(void **)&agents->genomeHash, a*sizeof(uint64_t)},
+        {(void **)&agents->genomeRefs, a*sizeof(int)},
+        {(void **)&agents->genomesNext, a*sizeof(int)},
+        {(void **)&agents->genomeTable, (size_t)(agents->genomeTableMask + 1)*sizeof(int)},
+    };
+    size_t count = sizeof(arrays)/sizeof(arrays[0]);
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += AlignSize(arrays[i].size);
+    game->memory = MapWorld(&total, config->hugePages);
+    if (game->memory == NULL) {
+        free(game);
+        return NULL;
+    }
+    game->memorySize = total;
+    game->hugePages = config->hugePages;
+
+    char *p = game->memory;
+    for (size_t i = 0; i < count; i++) {
+        *arrays[i].ptr = p;
+        p += AlignSize(arrays[i].size);
+    }
+
+    InitBitboard(&game->wallBits, game->wallBits.words, game->cellsCount);
+    InitBitboard(&game->foodBits, game->foodBits.words, game->cellsCount);
+    InitBitboard(&game->agentBits, game->agentBits.words, game->cellsCount);
+    InitHallOfFame(&game->hall, game->hall.entries, game->hall.genomes, game->hall.positions, game->hall.table,
+        config->hallOfFameCount, game->genesCount*sizeof(PackedGene));
+    SeedGame(game, config->seed);
+    ClearGame(game);
+
+    game->engineOps = GetEngineOps(config->engine);
+    if (game->engineOps->create) {
+        game->engine = game->engineOps->create(game, config);
+        if (game->engine == NULL) {
+            DestroyGame(game);
+            return NULL;
+        }
+    }
+    return game;
+}
+
+void DestroyGame(Game *game) {
+    if (game == NULL) return;
+    if (game->engine) game->engineOps->destroy(game->engine);
+    munmap(game->memory, game->memorySize);
+    free(game);
+}
+
+struct GameState {
+    Game game;
+    unsigned char *data; // the spans, then the genes of the live genomes
+};
+
+typedef struct {
+    void *ptr;
+    size_t size;
+} Span;
+
+#define STATE_SPANS 27
+
+// Parts of the world mapping that a step can read. Past the store count and
+// the pool tops the arrays hold nothing a later step reads, except the slot
+// generations, which outlive ClearGame. Freed genome entries keep stale
+// genes and the genome table is rebuilt, so neither is saved.
+static void GetStateSpans(const Game *game, Span *spans) {
+    const Agents *agents = &game->agents;
+    const HallOfFame *hall = &game->hall;
+    size_t n = game->cellsCount;
+    size_t a = agents->count;
+    size_t slots = agents->slotPool.top;
+    size_t genomes = agents->genomePool.top;
+    size_t hallGenes = (size_t)hall->capacity*game->genesCount;
+    const Span list[STATE_SPANS] = {
+        {game->grid, n*sizeof(AgentHandle)},
+        {game->cells, n*sizeof(Cell)},
+        {game->wallBits.words, BITBOARD_WORDS(n)*sizeof(uint64_t)},
+        {game->foodBits.words, BITBOARD_WORDS(n)*sizeof(uint64_t)},
+        {game->agentBits.words, BITBOARD_WORDS(n)*sizeof(uint64_t)},
+        {game->bestGenes, (size_t)game->bestGenesMax*game->genesCount*sizeof(PackedGene)},
+        {hall->entries, (size_t)hall->capacity*sizeof(HallEntry)},
+        {hall->genomes, hallGenes*sizeof(PackedGene)},
+        {hall->positions, (size_t)hall->capacity*sizeof(int)},
+        {hall->table, (size_t)(hall->tableMask + 1)*sizeof(int)},
+        {agents->dir, a*sizeof(Dir)},
+        {agents->health, a*sizeof(int)},
+        {agents->hunger, a*sizeof(int)},
+        {agents->geneIndex, a*sizeof(int)},
+        {agents->cell, a*sizeof(int)},
+        {agents->genome, a*sizeof(int)},
+        {agents->born, a*sizeof(long)},
+        {agents->offspring, a*sizeof(int)},
+        {agents->foodEaten, a*sizeof(int)},
+        {agents->kills, a*sizeof(int)},
+        {agents->handle, a*sizeof(AgentHandle)},
+        {agents->slotAgent, slots*sizeof(int)},
+        {agents->slotsNext, slots*sizeof(int)},
+        {agents->slotGeneration, (size_t)agents->slotsUsed*sizeof(uint32_t)},
+        {agents->genomeHash, genomes*sizeof(uint64_t)},
+        {agents->genomeRefs, genomes*sizeof(int)},
+        {agents->genomesNext, genomes*sizeof(int)},
+    };
+    memcpy(spans, list, sizeof(list));
+}
+
+GameState *SaveGameState(const Game *game) {
+    const Agents *agents = &game->agents;
+    Span spans[STATE_SPANS];
+    GetStateSpans(game, spans);
+    size_t genomeSize = game->genesCount*sizeof(PackedGene);
+    size_t size = (size_t)agents->genomePool.live*genomeSize;
+    for (int i = 0; i < STATE_SPANS; i++) size += spans[i].size;
+
+    GameState *state = malloc(sizeof(GameState));
+    if (state == NULL) return NULL;
+    state->data = malloc(size);
+    if (state->data == NULL) {
+        free(state);
+        return NULL;
+    }
+    state->game = *game;
+    unsigned char *p = state->data;
+    for (int i = 0; i < STATE_SPANS; i++) {
+        memcpy(p, spans[i].ptr, spans[i].size);
+        p += spans[i].size;
+    }
+    for (int g = 0; g < agents->genomePool.top; g++) {
+        if (agents->genomeRefs[g] == 0) continue;
+        memcpy(p, &agents->genomes[(size_t)g*game->genesCount], genomeSize);
+        p += genomeSize;
+    }
+    return state;
+}
+
+// The engines keep no state between steps, so the struct and the spans are
+// the whole world. The live genomes go back into the table in index order,
+// which may place them in other buckets than before; lookups and removals
+// find the same entries either way.
+void RestoreGameState(Game *game, const GameState *state) {
+    Agents *agents = &game->agents;
+    uint32_t mask = agents->genomeTableMask;
+    for (int g = 0; g < agents->genomePool.top; g++) {
+        if (agents->genomeRefs[g] == 0) continue;
+        uint32_t b = agents->genomeHash[g] & mask;
+        while (agents->genomeTable[b] != g) b = (b + 1) & mask;
+        agents->genomeTable[b] = GENOME_NONE;
+    }
+    // Slots first handed out after the save get their first generation again
+    int slotsUsed = state->game.agents.slotsUsed;
+    if (agents->slotsUsed > slotsUsed) {
+        memset(&agents->slotGeneration[slotsUsed], 0, (size_t)(agents->slotsUsed - slotsUsed)*sizeof(uint32_t));
+    }
+
+    *game = state->game;
+    Span spans[STATE_SPANS];
+    GetStateSpans(game, spans);
+    const unsigned char *p = state->data;
+    for (int i = 0; i < STATE_SPANS; i++) {
+        memcpy(spans[i].ptr, p, spans[i].size);
+        p += spans[i].size;
+    }
+    size_t genomeSize = game->genesCount*sizeof(PackedGene);
+    for (int g = 0; g < agents->genomePool.top; g++) {
+        if (agents->genomeRefs[g] == 0) continue;
+        memcpy(&agents->genomes[(size_t)g*game->genesCount], p, genomeSize);
+        p += genomeSize;
+        uint32_t b = agents->genomeHash[g] & mask;
+        while (agents->genomeTable[b] != GENOME_NONE) b = (b + 1) & mask;
+        agents->genomeTable[b] = g;
+    }
+}
+
+void FreeGameState(GameState *state) {
+    if (state == NULL) return;
+    free(state->data);
+    free(state);
+}
+
+Dir RandomDir(Rng *rng) {
+    return RngInt(rng, 0, 3);
+}
+
+Condition RandomCondition(Rng *rng) {
+    return RngInt(rng, 0, CONDITION_COUNT-1);
+}
+
+Action RandomAction(Rng *rng) {
+    return RngInt(rng, 0, ACTION_COUNT-1);
+}
+
+// Returns the index of the agent in the store, or -1 if the handle is stale
+int AgentIndex(Game *game, AgentHandle handle) {
+    Agents *agents = &game->agents;
+    if (handle == AGENT_NONE) return -1;
+    int slot = handle & agents->slotMask;
+    if (agents->slotGeneration[slot] != handle >> agents->slotBits) return -1;
+    return agents->slotAgent[slot];
+}
+
+bool IsAgentAlive(Game *game, AgentHandle handle) {
+    return AgentIndex(game, handle) >= 0;
+}
+
+// Table bucket holding genes, or the empty bucket where they would go
+static int *GenomeBucket(Game *game, const PackedGene *genes, uint64_t hash) {
+    Agents *agents = &game->agents;
+    size_t size = game->genesCount*sizeof(PackedGene);
+    for (uint32_t b = hash & agents->genomeTableMask;; b = (b + 1) & agents->genomeTableMask) {
+        int g = agents->genomeTable[b];
+        if (g == GENOME_NONE) return &agents->genomeTable[b];
+        if (agents->genomeHash[g] == hash && memcmp(&agents->genomes[(size_t)g*game->genesCount], genes, size) == 0) {
+            return &agents->genomeTable[b];
+        }
+    }
+}
+
+int InternGenome(Game *game, const PackedGene *genes) {
+    Agents *agents = &game->agents;
+    uint64_t hash = HashGenes(genes, game->genesCount);
+    int *bucket = GenomeBucket(game, genes, hash);
+    if (*bucket != GENOME_NONE) {
+        agents->genomeRefs[*bucket]++;
+        return *bucket;
+    }
+    // Live entries never outnumber agents plus the dead awaiting burial,
+    // both bounded by the store capacity
+    int g = AcquirePool(&agents->genomePool);
+    memcpy(&agents->genomes[(size_t)g*game->genesCount], genes, game->genesCount*sizeof(PackedGene));
+    agents->genomeHash[g] = hash;
+    agents->genomeRefs[g] = 1;
+    *bucket = g;
+    return g;
+}
+
+void ReleaseGenome(Game *game, int genome) {
+    Agents *agents = &game->agents;
+    if (--agents->genomeRefs[genome] > 0) return;
+
+    // Backward-shift deletion keeps every probe chain unbroken
+    uint32_t mask = agents->genomeTableMask;
+    uint32_t hole = agents->genomeHash[genome] & mask;
+    while (agents->genomeTable[hole] != genome) hole = (hole + 1) & mask;
+    for (uint32_t b = (hole + 1) & mask; agents->genomeTable[b] != GENOME_NONE; b = (b + 1) & mask) {
+        uint32_t home = agents->genomeHash[agents->genomeTable[b]] & mask;
+        // Move the entry back unless its home lies cyclically in (hole, b]
+        if (((b - home) & mask) >= ((b - hole) & mask)) {
+            agents->genomeTable[hole] = agents->genomeTable[b];
+            hole = b;
+        }
+    }
+    agents->genomeTable[hole] = GENOME_NONE;
+    ReleasePool(&agents->genomePool, genome);
+}
+
+int CountSpecies(const Game *game) {
+    return game->agents.genomePool.live;
+}
+
+static inline uint64_t MixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Share of one cell in cellsHash, empty cells add nothing
+static inline uint64_t CellHash(int cell, Cell value) {
+    return value ? MixHash((uint64_t)cell << 16 | value) : 0;
+}
+
+uint64_t RehashCells(const Game *game) {
+    uint64_t hash = 0;
+    for (int cell = 0; cell < game->cellsCount; cell++) hash ^= CellHash(cell, game->cells[cell]);
+    return hash;
+}
+
+// Tiles of the same colour can share plane words, concurrent updates
+// change them atomically
+static inline void WriteCellBit(Bitboard *plane, int cell, bool set, bool concurrent) {
+    if (concurrent) {
+        if (set) SetBitboardAtomic(plane, cell); else ResetBitboardAtomic(plane, cell);
+    } else {
+        if (set) SetBitboard(plane, cell); else ResetBitboard(plane, cell);
+    }
+}
+
+// Every cell write after ClearGame goes through here to keep the bit planes
+// and cellsHash in step. Updates that run concurrently (ctx->lock set)
+// collect their hash changes in ctx for the engine to fold in.
+static inline void WriteCell(Game *game, StepContext *ctx, int cell, Cell value) {
+    Cell old = game->cells[cell];
+    bool concurrent = ctx != NULL && ctx->lock != NULL;
+    uint64_t change = CellHash(cell, old) ^ CellHash(cell, value);
+    if (concurrent) {
+        ctx->cellsHash ^= change;
+    } else {
+        game->cellsHash ^= change;
+    }
+    if ((old ^ value) & CELL_WALL) WriteCellBit(&game->wallBits, cell, value & CELL_WALL, concurrent);
+    if ((old ^ value) & CELL_AGENT) WriteCellBit(&game->agentBits, cell, value & CELL_AGENT, concurrent);
+    if (!CELL_FOOD(old) != !CELL_FOOD(value)) WriteCellBit(&game->foodBits, cell, CELL_FOOD(value), concurrent);
+    game->cells[cell] = value;
+}
+
+static void SetFoodWith(Game *game, StepContext *ctx, int cell, int food) {
+    if (food > CELL_FOOD_MAX) food = CELL_FOOD_MAX;
+    WriteCell(game, ctx, cell, (game->cells[cell] & ~CELL_FOOD_MASK) | food);
+}
+
+// Generations wrap within the bits above the slot index, skipping 0
+static inline uint32_t NextGeneration(const Agents *agents, uint32_t generation) {
+    generation = (generation + 1) & (UINT32_MAX >> agents->slotBits);
+    return generation ? generation : 1;
+}
+
+// Places an agent that takes over one reference to genome, the store must
+// have room
+static int PlaceAgent(Game *game, StepContext *ctx, int cell, int genome) {
+    Agents *agents = &game->agents;
+    int slot = AcquirePool(&agents->slotPool);
+    if (agents->slotGeneration[slot] == 0) {
+        agents->slotGeneration[slot] = 1;
+        agents->slotsUsed = slot + 1;
+    }
+    int a = agents->count++;
+    agents->slotAgent[slot] = a;
+    agents->handle[a] = ((AgentHandle)agents->slotGeneration[slot] << agents->slotBits) | slot;
+    agents->cell[a] = cell;
+    agents->genome[a] = genome;
+    agents->born[a] = game->step;
+    agents->offspring[a] = 0;
+    agents->foodEaten[a] = 0;
+    agents->kills[a] = 0;
+    game->grid[cell] = agents->handle[a];
+    WriteCell(game, ctx, cell, game->cells[cell] | CELL_AGENT);
+    return a;
+}
+
+// Returns the index of the new agent, or -1 if the store is full
+int AddAgent(Game *game, int cell, const PackedGene *genes) {
+    if (game->agents.count == game->agents.capacity) return -1;
+    return PlaceAgent(game, NULL, cell, InternGenome(game, genes));
+}
+
+static void VacateAgentWith(Game *game, StepContext *ctx, int agent) {
+    int cell = game->agents.cell[agent];
+    game->grid[cell] = AGENT_NONE;
+    WriteCell(game, ctx, cell, game->cells[cell] & ~CELL_AGENT);
+}
+
+// Takes the agent off the board, its store entry stays until FreeAgent
+void VacateAgent(Game *game, int agent) {
+    VacateAgentWith(game, NULL, agent);
+}
+
+// Releases the slot and genome of an agent that is off the board and swaps
+// the last agent into its place to keep the store dense
+void FreeAgent(Game *game, int agent) {
+    Agents *agents = &game->agents;
+    ReleaseGenome(game, agents->genome[agent]);
+    int slot = agents->handle[agent] & agents->slotMask;
+    agents->slotGeneration[slot] = NextGeneration(agents, agents->slotGeneration[slot]);
+    ReleasePool(&agents->slotPool, slot);
+
+    int last = --agents->count;
+    if (agent != last) {
+        agents->dir[agent] = agents->dir[last];
+        agents->health[agent] = agents->health[last];
+        agents->hunger[agent] = agents->hunger[last];
+        agents->geneIndex[agent] = agents->geneIndex[last];
+        agents->cell[agent] = agents->cell[last];
+        agents->genome[agent] = agents->genome[last];
+        agents->born[agent] = agents->born[last];
+        agents->offspring[agent] = agents->offspring[last];
+        agents->foodEaten[agent] = agents->foodEaten[last];
+        agents->kills[agent] = agents->kills[last];
+        agents->handle[agent] = agents->handle[last];
+        agents->slotAgent[agents->handle[agent] & agents->slotMask] = agent;
+    }
+}
+
+void RemoveAgent(Game *game, int agent) {
+    VacateAgent(game, agent);
+    FreeAgent(game, agent);
+}
+
+// genes NULL shares the genome of parent, as the child of an unmutated
+// copy does
+static int AddAgentWith(Game *game, StepContext *ctx, int cell, const PackedGene *genes, int parent) {
+    Agents *agents = &game->agents;
+    int a = -1;
+    if (ctx->lock) pthread_mutex_lock(ctx->lock);
+    if (agents->count < agents->capacity) {
+        int genome = agents->genome[parent];
+        if (genes) {
+            genome = InternGenome(game, genes);
+        } else {
+            agents->genomeRefs[genome]++;
+        }
+        a = PlaceAgent(game, ctx, cell, genome);
+    }
+    if (ctx->lock) pthread_mutex_unlock(ctx->lock);
+    return a;
+}
+
+const PackedGene *GetAgentGenes(const Game *game, int agent) {
+    return &game->agents.genomes[(size_t)game->agents.genome[agent]*game->genesCount];
+}
+
+Agent GetAgent(Game *game, int agent) {
+    Agents *agents = &game->agents;
+    Agent a;
+    a.genesCount = game->genesCount;
+    memcpy(a.genes, GetAgentGenes(game, agent), game->genesCount*sizeof(PackedGene));
+    a.dir = agents->dir[agent];
+    a.health = agents->health[agent];
+    a.hunger = agents->hunger[agent];
+    a.geneIndex = agents->geneIndex[agent];
+    a.age = game->step - agents->born[agent];
+    a.offspring = agents->offspring[agent];
+    a.foodEaten = agents->foodEaten[agent];
+    a.kills = agents->kills[agent];
+    return a;
+}
+
+AgentHandle RandomAgent(Game *game, int cell) {
+    Agents *agents = &game->agents;
+    Rng rng = CellRng(game, cell, RNG_PURPOSE_AGENT);
+    Dir dir = RandomDir(&rng);
+    int geneIndex = RngInt(&rng, 0, game->genesCount-1);
+    PackedGene genes[GENES_COUNT_MAX];
+    for (int i = 0; i < game->genesCount; i++) {
+        Gene gene;
+        gene.cond = RandomCondition(&rng);
+        gene.action1 = RandomAction(&rng);
+        gene.action2 = RandomAction(&rng);
+        gene.next1 = RngInt(&rng, 0, game->genesCount-1);
+        gene.next2 = RngInt(&rng, 0, game->genesCount-1);
+        genes[i] = PackGene(gene);
+    }
+    int a = AddAgent(game, cell, genes);
+    if (a < 0) return AGENT_NONE;
+    agents->dir[a] = dir;
+    agents->health[a] = HEALTH_MAX;
+    agents->hunger[a] = 100;
+    agents->geneIndex[a] = geneIndex;
+    return agents->handle[a];
+}
+
+Dir GetReverseDir(Dir dir) {
+    switch (dir) {
+        case DIR_LEFT: return DIR_RIGHT;
+        case DIR_DOWN: return DIR_UP;
+        case DIR_RIGHT: return DIR_LEFT;
+        case DIR_UP: return DIR_DOWN;
+        default: return 0;
+    }
+}
+
+// Overwrites the oldest genome once the ring is full
+void ArchiveGenes(Game *game, const PackedGene *genes) {
+    game->bestGenesHead = (game->bestGenesHead + 1 == game->bestGenesMax) ? 0 : game->bestGenesHead + 1;
+    memcpy(&game->bestGenes[(size_t)game->bestGenesHead*game->genesCount], genes, game->genesCount*sizeof(PackedGene));
+    if (game->bestGenesCount < game->bestGenesMax) game->bestGenesCount++;
+}
+
+PackedGene *GetBestGenes(const Game *game, int i) {
+    int slot = game->bestGenesHead - i;
+    if (slot < 0) slot += game->bestGenesMax;
+    return &game->bestGenes[(size_t)slot*game->genesCount];
+}
+
+uint64_t HashGenes(const PackedGene *genes, int count) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < count; i++) {
+        h = (h ^ genes[i])*0x100000001b3ull;
+        h ^= h >> 29;
+    }
+    h = (h ^ (h >> 32))*0xd6e8feb86659fd93ull;
+    return h ^ (h >> 32);
+}
+
+long AgentFitness(const Game *game, int agent) {
+    const Agents *agents = &game->agents;
+    const Fitness *w = &game->fitness;
+    return w->age*(game->step - agents->born[agent]) + (long)w->offspring*agents->offspring[agent] +
+        (long)w->food*agents->foodEaten[agent] + (long)w->kills*agents->kills[agent];
+}
+
+void ArchiveAgent(Game *game, int agent) {
+    const PackedGene *genes = GetAgentGenes(game, agent);
+    ArchiveGenes(game, genes);
+    if (game->hall.capacity > 0) {
+        uint64_t hash = game->agents.genomeHash[game->agents.genome[agent]];
+        OfferHallOfFame(&game->hall, genes, hash, AgentFitness(game, agent));
+    }
+}
+
+void KillAgentWith(Game *game, StepContext *ctx, int agent) {
+    Agents *agents = &game->agents;
+    SetFoodWith(game, ctx, agents->cell[agent], (agents->hunger[agent] > 10) ? agents->hunger[agent] : 10);
+    if (ctx->dead) {
+        // Archived and freed by the engine once the step is done
+        VacateAgentWith(game, ctx, agent);
+        ctx->dead[ctx->deadCount++] = agent;
+        return;
+    }
+    ArchiveAgent(game, agent);
+    RemoveAgent(game, agent);
+}
+
+static int CompareDescending(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x < y) - (x > y);
+}
+
+// Archives the genomes of agents whose death was deferred, in list order,
+// then frees them from the highest index down so swap-removal never moves a
+// dead agent that is still to be freed. Sorts the list.
+void BuryAgents(Game *game, int *dead, int count) {
+    for (int i = 0; i < count; i++) {
+        ArchiveAgent(game, dead[i]);
+    }
+    qsort(dead, count, sizeof(int), CompareDescending);
+    for (int i = 0; i < count; i++) {
+        FreeAgent(game, dead[i]);
+    }
+}
+
+void KillAgent(Game *game, int agent) {
+    StepContext ctx = {0};
+    KillAgentWith(game, &ctx, agent);
+}
+
+AgentHandle ReproduceAgentWith(Game *game, StepContext *ctx, int parent, int cell) {
+    Agents *agents = &game->agents;
+    Rng stream = CellRng(game, cell, RNG_PURPOSE_MUTATION);
+    Rng *rng = &stream;
+    int geneIndex = RngInt(rng, 0, game->genesCount-1);
+    // Copy on write: the child shares the parent's genome unless a gene mutates
+    PackedGene genes[GENES_COUNT_MAX];
+    bool mutated = false;
+    for (int i = 0; i < game->genesCount; i++) {
+        if (RngInt(rng, 0, 100) <= 10) {
+            if (!mutated) {
+                memcpy(genes, GetAgentGenes(game, parent), game->genesCount*sizeof(PackedGene));
+                mutated = true;
+            }
+            Gene gene = UnpackGene(genes[i]);
+            int m = RngInt(rng, 0, 4); // cond, action1, action2, ...
+            switch (m) {
+                case 0: gene.cond = RandomCondition(rng); break;
+                case 1: gene.action1 = RandomAction(rng); break;
+                case 2: gene.action2 = RandomAction(rng); break;
+                case 3: gene.next1 = RngInt(rng, 0, game->genesCount-1); break;
+                case 4: gene.next2 = RngInt(rng, 0, game->genesCount-1); break;
+            }
+            genes[i] = PackGene(gene);
+        }
+    }
+
+    int a = AddAgentWith(game, ctx, cell, mutated ? genes : NULL, parent);
+    if (a < 0) return AGENT_NONE;
+    agents->dir[a] = GetReverseDir(agents->dir[parent]);
+    agents->hunger[a] = agents->hunger[parent]/2;
+    agents->hunger[parent] /= 2;
+    agents->health[a] = agents->health[parent];
+    agents->geneIndex[a] = geneIndex;
+    agents->offspring[parent]++;
+    return agents->handle[a];
+}
+
+AgentHandle ReproduceAgent(Game *game, int parent, int cell) {
+    StepContext ctx = {0};
+    return ReproduceAgentWith(game, &ctx, parent, cell);
+}
+
+Pos ToBoardPos(Game *game, Pos pos) {
+    pos.x = pos.x % game->width;
+    if (pos.x < 0) pos.x += game->width;
+    pos.y = pos.y % game->height;
+    if (pos.y < 0) pos.y += game->height;
+    return pos;
+}
+
+int PosToCell(Game *game, Pos pos) {
+    pos = ToBoardPos(game, pos);
+    return pos.y*game->width + pos.x;
+}
+
+Pos CellToPos(Game *game, int cell) {
+    return (Pos){cell%game->width, cell/game->width};
+}
+
+bool IsCellFree(Game *game, int cell) {
+    return (game->cells[cell] & (CELL_WALL | CELL_AGENT | CELL_FOOD_MASK)) == 0;
+}
+
+void SetFood(Game *game, int cell, int food) {
+    SetFoodWith(game, NULL, cell, food);
+}
+
+int CountFoodCells(const Game *game) {
+    return CountBitboard(&game->foodBits);
+}
+
+int CountWalls(const Game *game) {
+    return CountBitboard(&game->wallBits);
+}
+
+int CountPopulation(const Game *game) {
+    return CountBitboard(&game->agentBits);
+}
+
+uint64_t HashGame(const Game *game) {
+    const Agents *agents = &game->agents;
+    uint64_t agentsHash = 0;
+    for (int a = 0; a < agents->count; a++) {
+        uint64_t h = MixHash((uint64_t)agents->cell[a] << 32 | (uint32_t)agents->dir[a]);
+        h = MixHash(h ^ ((uint64_t)(uint32_t)agents->health[a] << 32 | (uint32_t)agents->hunger[a]));
+        h = MixHash(h ^ ((uint64_t)(uint32_t)agents->geneIndex[a] << 32 | (uint32_t)agents->offspring[a]));
+        h = MixHash(h ^ ((uint64_t)(uint32_t)agents->foodEaten[a] << 32 | (uint32_t)agents->kills[a]));
+        h = MixHash(h ^ (uint64_t)agents->born[a]);
+        agentsHash += MixHash(h ^ agents->genomeHash[agents->genome[a]]);
+    }
+    // The archive ring in age order, the hall by content
+    uint64_t archiveHash = MixHash(game->bestGenesCount);
+    for (int i = 0; i < game->bestGenesCount; i++) {
+        archiveHash = MixHash(archiveHash ^ HashGenes(GetBestGenes(game, i), game->genesCount));
+    }
+    uint64_t hallHash = 0;
+    for (int i = 0; i < game->hall.count; i++) {
+        hallHash += MixHash(game->hall.entries[i].hash ^ MixHash(game->hall.entries[i].fitness));
+    }
+    uint64_t hash = MixHash((uint64_t)game->step ^ game->cellsHash);
+    hash = MixHash(hash ^ agentsHash);
+    hash = MixHash(hash ^ archiveHash);
+    return MixHash(hash ^ hallHash);
+}
+
+Pos GetFrontPos(Game *game, Dir dir, Pos pos) {
+    switch (dir) {
+        case DIR_UP: pos.y--; break;
+        case DIR_DOWN: pos.y++; break;
+        case DIR_LEFT: pos.x--; break;
+        case DIR_RIGHT: pos.x++; break;
+        default: break;
+    }
+    return ToBoardPos(game, pos);
+}
+
+Pos GetBackPos(Game *game, Dir dir, Pos pos) {
+    switch (dir) {
+        case DIR_UP: pos.y++; break;
+        case DIR_DOWN: pos.y--; break;
+        case DIR_LEFT: pos.x++; break;
+        case DIR_RIGHT: pos.x--; break;
+        default: break;
+    }
+    return ToBoardPos(game, pos);
+}
+
+Pos GetLeftPos(Game *game, Dir dir, Pos pos) {
+    switch (dir) {
+        case DIR_UP: pos.x--; break;
+        case DIR_DOWN: pos.x++; break;
+        case DIR_LEFT: pos.y++; break;
+        case DIR_RIGHT: pos.y--; break;
+        default: break;
+    }
+    return ToBoardPos(game, pos);
+}
+
+Pos GetRightPos(Game *game, Dir dir, Pos pos) {
+    switch (dir) {
+        case DIR_UP: pos.x++; break;
+        case DIR_DOWN: pos.x--; break;
+        case DIR_LEFT: pos.y--; break;
+        case DIR_RIGHT: pos.y++; break;
+        default: break;
+    }
+    return ToBoardPos(game, pos);
+}
+
+// Slow path of NeighborCell for cells on the board edge
+int WrapNeighborCell(const Game *game, int cell, Dir dir, Side side) {
+    Pos pos = {cell%game->width, cell/game->width};
+    pos.x += game->neighborDx[dir][side];
+    pos.y += game->neighborDy[dir][side]/game->width;
+    if (pos.x < 0) pos.x += game->width;
+    if (pos.x >= game->width) pos.x -= game->width;
+    if (pos.y < 0) pos.y += game->height;
+    if (pos.y >= game->height) pos.y -= game->height;
+    return pos.y*game->width + pos.x;
+}
+
+Dir TurnLeft(Dir dir) {
+    switch (dir) {
+        case DIR_LEFT: return DIR_DOWN;
+        case DIR_DOWN: return DIR_RIGHT;
+        case DIR_RIGHT: return DIR_UP;
+        case DIR_UP: return DIR_LEFT;
+    }
+    return 0;
+}
+
+Dir TurnRight(Dir dir) {
+    switch (dir) {
+        case DIR_LEFT: return DIR_UP;
+        case DIR_DOWN: return DIR_LEFT;
+        case DIR_RIGHT: return DIR_DOWN;
+        case DIR_UP: return DIR_RIGHT;
+    }
+    return 0;
+}
+
+static inline void MoveAgentTo(Game *game, StepContext *ctx, int agent, int to) {
+    Agents *agents = &game->agents;
+    int cell = agents->cell[agent];
+    game->grid[to] = agents->handle[agent];
+    game->grid[cell] = AGENT_NONE;
+    WriteCell(game, ctx, to, game->cells[to] | CELL_AGENT);
+    WriteCell(game, ctx, cell, game->cells[cell] & ~CELL_AGENT);
+    agents->cell[agent] = to;
+}
+
+// The baseline rule: once the target's health reaches zero the attacker is
+// removed, not the target, which lives on until it starves. The kill is
+// credited in the same call, so kills is 0 for every living agent and 1 at
+// most, seen only by ArchiveAgent as a bonus for dying by a fatal attack.
+static inline void AttackAgent(Game *game, StepContext *ctx, int agent, int target) {
+    Agents *agents = &game->agents;
+    agents->health[target] -= 10;
+    if (agents->health[target] <= 0) {
+        agents->kills[agent]++;
+        KillAgentWith(game, ctx, agent);
+    }
+}
+
+static inline void EatFood(Game *game, StepContext *ctx, int agent, int cell) {
+    game->agents.hunger[agent] += CELL_FOOD(game->cells[cell]);
+    game->agents.foodEaten[agent] += CELL_FOOD(game->cells[cell]);
+    SetFoodWith(game, ctx, cell, 0);
+}
+
+static inline void ExecuteActionOf(Game *game, StepContext *ctx, int agent, Action action, bool powerOfTwo) {
+    Agents *agents = &game->agents;
+    int cell = agents->cell[agent];
+    switch (action) {
+        case ACTION_DO_NOTHING: break;
+        case ACTION_MOVE: {
+            int front = NeighborCellOf(game, cell, agents->dir[agent], SIDE_FRONT, powerOfTwo);
+            if (IsCellFree(game, front)) {
+                MoveAgentTo(game, ctx, agent, front);
+            }
+        } break;
+        case ACTION_TURN_LEFT: {
+            agents->dir[agent] = TurnLeft(agents->dir[agent]);
+        } break;
+        case ACTION_TURN_RIGHT: {
+            agents->dir[agent] = TurnRight(agents->dir[agent]);
+        } break;
+        case ACTION_ATTACK: {
+            int front = NeighborCellOf(game, cell, agents->dir[agent], SIDE_FRONT, powerOfTwo);
+            int target = AgentIndex(game, game->grid[front]);
+            if (target >= 0) {
+                AttackAgent(game, ctx, agent, target);
+            }
+        } break;
+        case ACTION_EAT: {
+            int front = NeighborCellOf(game, cell, agents->dir[agent], SIDE_FRONT, powerOfTwo);
+            if (CELL_FOOD(game->cells[front]) != 0) {
+                EatFood(game, ctx, agent, front);
+            }
+        } break;
+        case ACTION_REPRODUCE: {
+            int back = NeighborCellOf(game, cell, agents->dir[agent], SIDE_BACK, powerOfTwo);
+            if (IsCellFree(game, back)) {
+                ReproduceAgentWith(game, ctx, agent, back);
+            }
+        } break;
+        default: break;
+    }
+}
+
+static inline bool ExecuteConditionOf(Game *game, int agent, Condition cond, bool powerOfTwo) {
+    Dir dir = game->agents.dir[agent];
+    int cell = game->agents.cell[agent];
+    switch (cond) {
+        case CONDITION_ALWAYS: return true;
+        case CONDITION_FRONT_IS_FREE: return IsCellFree(game, NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo));
+        case CONDITION_LEFT_IS_FREE: return IsCellFree(game, NeighborCellOf(game, cell, dir, SIDE_LEFT, powerOfTwo));
+        case CONDITION_RIGHT_IS_FREE: return IsCellFree(game, NeighborCellOf(game, cell, dir, SIDE_RIGHT, powerOfTwo));
+        case CONDITION_FOOD_IN_FRONT: return CELL_FOOD(game->cells[NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo)]) != 0;
+        case CONDITION_FOOD_ON_LEFT: return CELL_FOOD(game->cells[NeighborCellOf(game, cell, dir, SIDE_LEFT, powerOfTwo)]) != 0;
+        case CONDITION_FOOD_ON_RIGHT: return CELL_FOOD(game->cells[NeighborCellOf(game, cell, dir, SIDE_RIGHT, powerOfTwo)]) != 0;
+        case CONDITION_AGENT_IN_FRONT: return (game->cells[NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo)] & CELL_AGENT) != 0;
+        case CONDITION_AGENT_ON_LEFT: return (game->cells[NeighborCellOf(game, cell, dir, SIDE_LEFT, powerOfTwo)] & CELL_AGENT) != 0;
+        case CONDITION_AGENT_ON_RIGHT: return (game->cells[NeighborCellOf(game, cell, dir, SIDE_RIGHT, powerOfTwo)] & CELL_AGENT) != 0;
+        case CONDITION_WALL_IN_FRONT: return (game->cells[NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo)] & CELL_WALL) != 0;
+        case CONDITION_WALL_ON_LEFT: return (game->cells[NeighborCellOf(game, cell, dir, SIDE_LEFT, powerOfTwo)] & CELL_WALL) != 0;
+        case CONDITION_WALL_ON_RIGHT: return (game->cells[NeighborCellOf(game, cell, dir, SIDE_RIGHT, powerOfTwo)] & CELL_WALL) != 0;
+        default: return true;
+    }
+}
+
+static const uint8_t conditionSensors[CONDITION_COUNT] = {
+    [CONDITION_ALWAYS] = SENSOR_ALWAYS_BIT,
+    [CONDITION_FRONT_IS_FREE] = SENSOR_BIT(SENSOR_FRONT, SENSOR_FREE),
+    [CONDITION_LEFT_IS_FREE] = SENSOR_BIT(SENSOR_LEFT, SENSOR_FREE),
+    [CONDITION_RIGHT_IS_FREE] = SENSOR_BIT(SENSOR_RIGHT, SENSOR_FREE),
+    [CONDITION_FOOD_IN_FRONT] = SENSOR_BIT(SENSOR_FRONT, SENSOR_FOOD),
+    [CONDITION_FOOD_ON_LEFT] = SENSOR_BIT(SENSOR_LEFT, SENSOR_FOOD),
+    [CONDITION_FOOD_ON_RIGHT] = SENSOR_BIT(SENSOR_RIGHT, SENSOR_FOOD),
+    [CONDITION_AGENT_IN_FRONT] = SENSOR_BIT(SENSOR_FRONT, SENSOR_AGENT),
+    [CONDITION_AGENT_ON_LEFT] = SENSOR_BIT(SENSOR_LEFT, SENSOR_AGENT),
+    [CONDITION_AGENT_ON_RIGHT] = SENSOR_BIT(SENSOR_RIGHT, SENSOR_AGENT),
+    [CONDITION_WALL_IN_FRONT] = SENSOR_BIT(SENSOR_FRONT, SENSOR_WALL),
+    [CONDITION_WALL_ON_LEFT] = SENSOR_BIT(SENSOR_LEFT, SENSOR_WALL),
+    [CONDITION_WALL_ON_RIGHT] = SENSOR_BIT(SENSOR_RIGHT, SENSOR_WALL),
+};
+
+bool SensorCondition(SensorMask sensors, Condition cond) {
+    return (sensors >> conditionSensors[cond]) & 1;
+}
+
+static inline SensorMask SenseCell(Cell cell, int side) {
+    return ((cell & (CELL_WALL | CELL_AGENT | CELL_FOOD_MASK)) == 0) << SENSOR_BIT(side, SENSOR_FREE) |
+        (CELL_FOOD(cell) != 0) << SENSOR_BIT(side, SENSOR_FOOD) |
+        ((cell & CELL_AGENT) != 0) << SENSOR_BIT(side, SENSOR_AGENT) |
+        ((cell & CELL_WALL) != 0) << SENSOR_BIT(side, SENSOR_WALL);
+}
+
+static inline SensorMask SenseAgentOf(const Game *game, int agent, bool powerOfTwo) {
+    Dir dir = game->agents.dir[agent];
+    int cell = game->agents.cell[agent];
+    return 1 << SENSOR_ALWAYS_BIT |
+        SenseCell(game->cells[NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo)], SENSOR_FRONT) |
+        SenseCell(game->cells[NeighborCellOf(game, cell, dir, SIDE_LEFT, powerOfTwo)], SENSOR_LEFT) |
+        SenseCell(game->cells[NeighborCellOf(game, cell, dir, SIDE_RIGHT, powerOfTwo)], SENSOR_RIGHT);
+}
+
+SensorMask SenseAgent(const Game *game, int agent) {
+    return SenseAgentOf(game, agent, game->powerOfTwo);
+}
+
+static void SenseAgentsOf(const Game *game, int from, int to, SensorMask *sensors, bool powerOfTwo) {
+    for (int a = from; a < to; a++) {
+        sensors[a] = SenseAgentOf(game, a, powerOfTwo);
+    }
+}
+
+void SenseAgents(const Game *game, int from, int to, SensorMask *sensors) {
+    if (game->powerOfTwo) {
+        SenseAgentsOf(game, from, to, sensors, true);
+    } else {
+        SenseAgentsOf(game, from, to, sensors, false);
+    }
+}
+
+// Absolute direction of the sensed sides by heading
+static const Dir senseDirs[4][SENSOR_SIDES] = {
+    [DIR_LEFT] = {[SENSOR_FRONT] = DIR_LEFT, [SENSOR_LEFT] = DIR_DOWN, [SENSOR_RIGHT] = DIR_UP},
+    [DIR_RIGHT] = {[SENSOR_FRONT] = DIR_RIGHT, [SENSOR_LEFT] = DIR_UP, [SENSOR_RIGHT] = DIR_DOWN},
+    [DIR_UP] = {[SENSOR_FRONT] = DIR_UP, [SENSOR_LEFT] = DIR_LEFT, [SENSOR_RIGHT] = DIR_RIGHT},
+    [DIR_DOWN] = {[SENSOR_FRONT] = DIR_DOWN, [SENSOR_LEFT] = DIR_RIGHT, [SENSOR_RIGHT] = DIR_LEFT},
+};
+
+void ShiftSensorPlanes(const Game *game, Bitboard *planes, int from, int to) {
+    static const int dx[4] = {[DIR_LEFT] = -1, [DIR_RIGHT] = 1};
+    static const int dy[4] = {[DIR_UP] = -1, [DIR_DOWN] = 1};
+    for (int p = from; p < to; p++) {
+        int dir = p/(SENSOR_KINDS - 1);
+        int kind = p%(SENSOR_KINDS - 1) + SENSOR_FOOD;
+        const Bitboard *plane = (kind == SENSOR_FOOD) ? &game->foodBits :
+            (kind == SENSOR_AGENT) ? &game->agentBits : &game->wallBits;
+        ShiftBitboard(&planes[p], plane, game->width, dx[dir], dy[dir]);
+    }
+}
+
+void SenseAgentsFromPlanes(const Game *game, const Bitboard *planes, int from, int to, SensorMask *sensors) {
+    const Agents *agents = &game->agents;
+    for (int w = from; w < to; w++) {
+        uint64_t occupied = game->agentBits.words[w];
+        if (occupied == 0) continue;
+        // Every agent in the word reads the same word of each plane
+        uint64_t seen[SENSOR_PLANES];
+        for (int p = 0; p < SENSOR_PLANES; p++) seen[p] = planes[p].words[w];
+        for (; occupied; occupied &= occupied - 1) {
+            int bit = __builtin_ctzll(occupied);
+            int a = agents->slotAgent[game->grid[w*64 + bit] & agents->slotMask];
+            const Dir *dirs = senseDirs[agents->dir[a]];
+            SensorMask mask = 1 << SENSOR_ALWAYS_BIT;
+            for (int side = 0; side < SENSOR_SIDES; side++) {
+                const uint64_t *p = &seen[SENSOR_PLANE(dirs[side], SENSOR_FOOD)];
+                unsigned food = (p[SENSOR_FOOD - SENSOR_FOOD] >> bit) & 1;
+                unsigned agent = (p[SENSOR_AGENT - SENSOR_FOOD] >> bit) & 1;
+                unsigned wall = (p[SENSOR_WALL - SENSOR_FOOD] >> bit) & 1;
+                mask |= (food | agent | wall) == 0 ? 1 << SENSOR_BIT(side, SENSOR_FREE) : 0;
+                mask |= food << SENSOR_BIT(side, SENSOR_FOOD) | agent << SENSOR_BIT(side, SENSOR_AGENT) |
+                    wall << SENSOR_BIT(side, SENSOR_WALL);
+            }
+            sensors[a] = mask;
+        }
+    }
+}
+
+static inline void UpdateAgentOf(Game *game, StepContext *ctx, int agent, bool powerOfTwo) {
+    Agents *agents = &game->agents;
+    agents->hunger[agent] -= 5;
+    if (agents->hunger[agent] < 0) {
+        agents->hunger[agent] = 0;
+        agents->health[agent] -= 10;
+        if (agents->health[agent] <= 0) {
+            KillAgentWith(game, ctx, agent);
+            return;
+        }
+    }
+    // The gene pointer advances before the action runs, the action may
+    // kill the agent and move another one into its slot
+    PackedGene gene = GetAgentGenes(game, agent)[agents->geneIndex[agent]];
+    uint32_t branch = GeneBranch(gene, ExecuteConditionOf(game, agent, GeneCondition(gene), powerOfTwo));
+    agents->geneIndex[agent] = BranchNext(branch);
+    ExecuteActionOf(game, ctx, agent, BranchAction(branch), powerOfTwo);
+}
+
+// First half of UpdateAgentOf for the intent engine: applies hunger, runs
+// the current gene and turns the agent, but only records what the action
+// would do to the board. Reads the board without writing it.
+static inline bool DecideAgentOf(Game *game, int agent, SensorMask sensors, Intent *intent, bool powerOfTwo) {
+    Agents *agents = &game->agents;
+    int cell = agents->cell[agent];
+    agents->hunger[agent] -= 5;
+    if (agents->hunger[agent] < 0) {
+        agents->hunger[agent] = 0;
+        agents->health[agent] -= 10;
+        if (agents->health[agent] <= 0) {
+            *intent = (Intent){agent, cell, INTENT_DIE};
+            return true;
+        }
+    }
+    PackedGene gene = GetAgentGenes(game, agent)[agents->geneIndex[agent]];
+    uint32_t branch = GeneBranch(gene, SensorCondition(sensors, GeneCondition(gene)));
+    agents->geneIndex[agent] = BranchNext(branch);
+    Action action = BranchAction(branch);
+
+    Dir dir = agents->dir[agent];
+    switch (action) {
+        case ACTION_TURN_LEFT: agents->dir[agent] = TurnLeft(dir); return false;
+        case ACTION_TURN_RIGHT: agents->dir[agent] = TurnRight(dir); return false;
+        case ACTION_MOVE: {
+            if (!(sensors >> SENSOR_BIT(SENSOR_FRONT, SENSOR_FREE) & 1)) return false;
+            *intent = (Intent){agent, NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo), INTENT_MOVE};
+        } return true;
+        case ACTION_ATTACK: {
+            if (!(sensors >> SENSOR_BIT(SENSOR_FRONT, SENSOR_AGENT) & 1)) return false;
+            int target = AgentIndex(game, game->grid[NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo)]);
+            if (target < 0) return false;
+            *intent = (Intent){agent, target, INTENT_ATTACK};
+        } return true;
+        case ACTION_EAT: {
+            if (!(sensors >> SENSOR_BIT(SENSOR_FRONT, SENSOR_FOOD) & 1)) return false;
+            *intent = (Intent){agent, NeighborCellOf(game, cell, dir, SIDE_FRONT, powerOfTwo), INTENT_EAT};
+        } return true;
+        case ACTION_REPRODUCE: {
+            int back = NeighborCellOf(game, cell, dir, SIDE_BACK, powerOfTwo);
+            if (!IsCellFree(game, back)) return false;
+            *intent = (Intent){agent, back, INTENT_REPRODUCE};
+        } return true;
+        default: return false;
+    }
+}
+
+static int DecideAgentsOf(Game *game, int from, int to, const SensorMask *sensors, Intent *intents, bool powerOfTwo) {
+    int n = 0;
+    for (int a = from; a < to; a++) {
+        n += DecideAgentOf(game, a, sensors[a], &intents[n], powerOfTwo);
+    }
+    return n;
+}
+
+int DecideAgents(Game *game, int from, int to, const SensorMask *sensors, Intent *intents) {
+    if (game->powerOfTwo) {
+        return DecideAgentsOf(game, from, to, sensors, intents, true);
+    }
+    return DecideAgentsOf(game, from, to, sensors, intents, false);
+}
+
+void ApplyIntent(Game *game, StepContext *ctx, const Intent *intent) {
+    switch (intent->kind) {
+        case INTENT_MOVE: MoveAgentTo(game, ctx, intent->agent, intent->target); break;
+        case INTENT_ATTACK: AttackAgent(game, ctx, intent->agent, intent->target); break;
+        case INTENT_EAT: EatFood(game, ctx, intent->agent, intent->target); break;
+        case INTENT_REPRODUCE: ReproduceAgentWith(game, ctx, intent->agent, intent->target); break;
+        case INTENT_DIE: KillAgentWith(game, ctx, intent->agent); break;
+    }
+}
+
+bool ExecuteCondition(Game *game, int agent, Condition cond) {
+    return ExecuteConditionOf(game, agent, cond, game->powerOfTwo);
+}
+
+void ExecuteAction(Game *game, int agent, Action action) {
+    StepContext ctx = {0};
+    ExecuteActionOf(game, &ctx, agent, action, game->powerOfTwo);
+}
+
+void UpdateAgentWith(Game *game, StepContext *ctx, int agent) {
+    if (game->powerOfTwo) {
+        UpdateAgentOf(game, ctx, agent, true);
+    } else {
+        UpdateAgentOf(game, ctx, agent, false);
+    }
+}
+
+void UpdateAgent(Game *game, int agent) {
+    StepContext ctx = {0};
+    UpdateAgentWith(game, &ctx, agent);
+}
+
+// Walks the store from the back: agents born during the step are appended
+// behind the cursor and a dead agent is replaced by one that already ran
+static void StepAgents(Game *game, bool powerOfTwo) {
+    StepContext ctx = {0};
+    for (int a = game->agents.count - 1; a >= 0; a--) {
+        UpdateAgentOf(game, &ctx, a, powerOfTwo);
+    }
+}
+
+static void StepSerial(Game *game, void *engine) {
+    (void)engine;
+    if (game->powerOfTwo) {
+        StepAgents(game, true);
+    } else {
+        StepAgents(game, false);
+    }
+}
+
+static void *CreateTiles(Game *game, const GameConfig *config) {
+    return CreateTileEngine(game, config->threads, config->tileSize);
+}
+
+static void DestroyTiles(void *engine) {
+    DestroyTileEngine(engine);
+}
+
+static void StepTiles(Game *game, void *engine) {
+    (void)game;
+    StepTileEngine(engine);
+}
+
+static void *CreateIntents(Game *game, const GameConfig *config) {
+    return CreateIntentEngine(game, config->threads, config->planeSensing);
+}
+
+static void DestroyIntents(void *engine) {
+    DestroyIntentEngine(engine);
+}
+
+static void StepIntents(Game *game, void *engine) {
+    (void)game;
+    StepIntentEngine(engine);
+}
+
+static const EngineOps engines[ENGINE_COUNT] = {
+    [ENGINE_SERIAL] = {"serial", NULL, NULL, StepSerial},
+    [ENGINE_TILES] = {"tiles", CreateTiles, DestroyTiles, StepTiles},
+    [ENGINE_INTENTS] = {"intents", CreateIntents, DestroyIntents, StepIntents},
+};
+
+const EngineOps *GetEngineOps(Engine engine) {
+    return &engines[engine];
+}
+
+void StepGame(Game *game) {
+    PROFILE_ZONE("StepGame");
+    game->engineOps->step(game, game->engine);
+    game->step++;
+    game->allDie = game->agents.count == 0;
+}
+
+void CreateWallsAndFoods(Game *game) {
+    for (int cell = 0; cell < game->cellsCount; cell++) {
+        if (IsCellFree(game, cell)) {
+            Rng rng = CellRng(game, cell, RNG_PURPOSE_WORLD);
+            if (RngInt(&rng, 0, 100) <= 1) {
+                WriteCell(game, NULL, cell, game->cells[cell] | CELL_WALL);
+            } else if (RngInt(&rng, 0, 100) <= 30) {
+                SetFood(game, cell, 50);
+            }
+        }
+    }
+}
+// Resets the world to an empty board. Agent slot generations are kept and
+// bumped, so handles taken before the reset stay stale.
+void ClearGame(Game *game) {
+    Agents *agents = &game->agents;
+    for (int i = 0; i < agents->slotPool.top; i++) {
+        if (agents->slotGeneration[i] != 0) agents->slotGeneration[i] = NextGeneration(agents, agents->slotGeneration[i]);
+    }
+    agents->count = 0;
+    InitPool(&agents->slotPool, agents->slotsNext, agents->capacity);
+    InitPool(&agents->genomePool, agents->genomesNext, agents->capacity);
+    memset(agents->genomeTable, 0xff, (size_t)(agents->genomeTableMask + 1)*sizeof(int));
+
+    memset(game->grid, 0, game->cellsCount*sizeof(AgentHandle));
+    memset(game->cells, 0, game->cellsCount*sizeof(Cell));
+    ClearBitboard(&game->wallBits);
+    ClearBitboard(&game->foodBits);
+    ClearBitboard(&game->agentBits);
+    int width = game->width;
+    int height = game->height;
+    for (int x = 0; x < width; x++) {
+        game->cells[x] |= CELL_BORDER;
+        game->cells[(height - 1)*width + x] |= CELL_BORDER;
+    }
+    for (int y = 0; y < height; y++) {
+        game->cells[y*width] |= CELL_BORDER;
+        game->cells[y*width + width - 1] |= CELL_BORDER;
+    }
+    game->cellsHash = RehashCells(game);
+
+    game->bestGenesCount = 0;
+    game->allDie = false;
+}
+
+void InitGame(Game *game) {
+    ClearGame(game);
+    ClearHallOfFame(&game->hall);
+    
+    int step = 3;
+    for (int y = 0; y < game->height; y += step) {
+        for (int x = 0; x < game->width; x += step) {
+            RandomAgent(game, y*game->width + x);
+        }
+    }
+    
+    CreateWallsAndFoods(game);
+}
+
+AgentHandle AgentFromGenes(Game *game, const PackedGene *genes, int cell) {
+    Agents *agents = &game->agents;
+    int a = AddAgent(game, cell, genes);
+    if (a < 0) return AGENT_NONE;
+    Rng rng = CellRng(game, cell, RNG_PURPOSE_AGENT);
+    agents->dir[a] = RandomDir(&rng);
+    agents->health[a] = HEALTH_MAX;
+    agents->hunger[a] = 100;
+    agents->geneIndex[a] = RngInt(&rng, 0, game->genesCount - 1);
+    return agents->handle[a];
+}
+
+void ReinitGame(Game *game) {
+    PROFILE_ZONE("ReinitGame");
+    // ClearGame empties the archive but keeps its head, and nothing dies
+    // while the board is refilled, so the old genomes stay readable
+    int bestGenesCount = game->bestGenesCount;
+    HallOfFame *hall = &game->hall;
+
+    ClearGame(game);
+
+    int step = 3;
+    for (int y = 0; y < game->height; y += step) {
+        for (int x = 0; x < game->width; x += step) {
+            int cell = y*game->width + x;
+            Rng rng = CellRng(game, cell, RNG_PURPOSE_REINIT);
+            if (RngInt(&rng, 0, 100) <= 70) {
+                PackedGene *genes = (hall->count > 0) ?
+                    GetHallOfFameGenome(hall, RngInt(&rng, 0, hall->count-1)) :
+                    GetBestGenes(game, RngInt(&rng, 0, bestGenesCount-1));
+                AgentFromGenes(game, genes, cell);
+            } else {
+                RandomAgent(game, cell);
+            }
+        }
+    } 
+
+    CreateWallsAndFoods(game);
+}
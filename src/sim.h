@@ -0,0 +1,501 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pool.h"
+#include "rng.h"
+#include "hall.h"
+#include "bitboard.h"
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Defaults, all of them can be changed at runtime through GameConfig
+#define BOARD_WIDTH  200
+#define BOARD_HEIGHT 100
+#define GENES_COUNT 10
+#define BEST_GENES_COUNT 50
+#define HALL_OF_FAME_COUNT 50
+
+#define TILE_SIZE 32
+#define THREADS_MAX 256
+
+#define GENES_COUNT_MAX 64
+#define HEALTH_MAX 100
+
+typedef enum {
+    DIR_LEFT = 0,
+    DIR_RIGHT,
+    DIR_UP,
+    DIR_DOWN,
+} Dir;
+
+// Neighbour of an agent relative to the direction it faces
+typedef enum {
+    SIDE_FRONT = 0,
+    SIDE_BACK,
+    SIDE_LEFT,
+    SIDE_RIGHT,
+    SIDE_COUNT,
+} Side;
+
+typedef enum {
+    CONDITION_ALWAYS = 0,
+    CONDITION_FRONT_IS_FREE,
+    CONDITION_LEFT_IS_FREE,
+    CONDITION_RIGHT_IS_FREE,
+    CONDITION_FOOD_IN_FRONT,
+    CONDITION_FOOD_ON_LEFT,
+    CONDITION_FOOD_ON_RIGHT,
+    CONDITION_AGENT_IN_FRONT,
+    CONDITION_AGENT_ON_LEFT,
+    CONDITION_AGENT_ON_RIGHT,
+    CONDITION_WALL_IN_FRONT,
+    CONDITION_WALL_ON_LEFT,
+    CONDITION_WALL_ON_RIGHT,
+    CONDITION_COUNT,
+} Condition;
+
+typedef enum {
+    ACTION_DO_NOTHING = 0,
+    ACTION_MOVE,
+    ACTION_ATTACK,
+    ACTION_EAT,
+    ACTION_TURN_LEFT,
+    ACTION_TURN_RIGHT,
+    ACTION_REPRODUCE,
+    ACTION_COUNT,
+} Action;
+
+typedef struct {
+    Condition cond;
+    Action action1; // if cond is true
+    int next1; // if cond is true
+    Action action2; // if cond is false
+    int next2; // if cond is false
+} Gene;
+
+// Gene packed into 32 bits, the form genomes are stored and run in. Each
+// branch takes 10 bits, (action << 6 | next): the true branch in bits 0-9,
+// the false one in bits 10-19 and the condition above them. A genome of
+// 10 genes is 40 bytes.
+typedef uint32_t PackedGene;
+
+#define GENE_BRANCH_BITS 10
+#define GENE_BRANCH_MASK 0x3ff
+#define GENE_NEXT_MASK 0x3f
+#define GENE_ACTION_SHIFT 6
+#define GENE_COND_SHIFT 20
+
+_Static_assert(GENES_COUNT_MAX <= GENE_NEXT_MASK + 1, "next gene index must fit 6 bits");
+_Static_assert(ACTION_COUNT <= 16, "action must fit 4 bits");
+_Static_assert(CONDITION_COUNT <= 32, "condition must fit 5 bits");
+
+static inline PackedGene PackGene(Gene gene) {
+    return (PackedGene)gene.next1 | (PackedGene)gene.action1 << GENE_ACTION_SHIFT |
+        ((PackedGene)gene.next2 | (PackedGene)gene.action2 << GENE_ACTION_SHIFT) << GENE_BRANCH_BITS |
+        (PackedGene)gene.cond << GENE_COND_SHIFT;
+}
+
+static inline Condition GeneCondition(PackedGene gene) {
+    return gene >> GENE_COND_SHIFT;
+}
+
+// Branch taken for a condition result, read with BranchNext/BranchAction
+static inline uint32_t GeneBranch(PackedGene gene, bool cond) {
+    return (gene >> (cond ? 0 : GENE_BRANCH_BITS)) & GENE_BRANCH_MASK;
+}
+
+static inline int BranchNext(uint32_t branch) {
+    return branch & GENE_NEXT_MASK;
+}
+
+static inline Action BranchAction(uint32_t branch) {
+    return branch >> GENE_ACTION_SHIFT;
+}
+
+static inline Gene UnpackGene(PackedGene gene) {
+    uint32_t taken = GeneBranch(gene, true);
+    uint32_t other = GeneBranch(gene, false);
+    return (Gene){
+        .cond = GeneCondition(gene),
+        .action1 = BranchAction(taken),
+        .next1 = BranchNext(taken),
+        .action2 = BranchAction(other),
+        .next2 = BranchNext(other),
+    };
+}
+
+typedef struct {
+    int x;
+    int y;
+} Pos;
+
+// A single agent copied out of the store
+typedef struct {
+    PackedGene genes[GENES_COUNT_MAX];
+    int genesCount;
+    Dir dir;
+    int health;
+    int hunger;
+    int geneIndex;
+    long age;
+    int offspring;
+    int foodEaten;
+    int kills;
+} Agent;
+
+// Stable 32-bit reference to an agent: slot index in the low slotBits bits
+// and the slot generation in the others, so a smaller store leaves more
+// generation bits (17 on the default board). Generations start at 1 so a
+// valid handle is never 0, and a handle goes stale as soon as its slot is
+// released. Slots are recycled oldest first, so a stale handle only
+// aliases after its slot has gone round every generation.
+typedef uint32_t AgentHandle;
+
+#define AGENT_NONE 0
+#define AGENTS_CAPACITY_MAX (1 << 24) // leaves at least 8 generation bits
+
+// Structure-of-arrays agent store, live agents are packed into [0, count)
+typedef struct {
+    Dir *dir;
+    int *health;
+    int *hunger;
+    int *geneIndex;
+    int *cell; // y*width + x
+    int *genome; // index into the genome table, shared between agents
+    // Lifetime metrics, ranked by the hall of fame at death
+    long *born; // step the agent was placed or born
+    int *offspring;
+    int *foodEaten;
+    int *kills; // fatal attacks, 0 or 1 and only at death: see AttackAgent
+    AgentHandle *handle;
+    // Population: PlaceAgent (behind AddAgent and births) raises it,
+    // FreeAgent lowers it. The agent's cell, bit plane and cellsHash share
+    // are written separately by PlaceAgent and VacateAgent through WriteCell.
+    int count;
+    int capacity;
+    // Slots give agents a stable identity while the arrays above stay dense
+    int *slotAgent; // slot -> index into the arrays above
+    uint32_t *slotGeneration;
+    int slotBits; // index bits of a handle, enough for capacity
+    int slotsUsed; // slots below have a generation, ClearGame keeps it
+    AgentHandle slotMask;
+    int *slotsNext;
+    Pool slotPool;
+    // Interned genomes: one immutable entry per distinct genome, reference
+    // counted by the agents carrying it. Children that inherit their
+    // parent's genome unmutated share the entry, so the live entry count is
+    // the number of species.
+    PackedGene *genomes; // capacity*genesCount
+    uint64_t *genomeHash;
+    int *genomeRefs;
+    int *genomesNext;
+    Pool genomePool;
+    // Open-addressing index of the live entries by hash, linear probing
+    int *genomeTable; // genomeTableMask + 1 entries, GENOME_NONE when empty
+    uint32_t genomeTableMask;
+} Agents;
+
+#define GENOME_NONE -1
+
+// Terrain and occupancy of one cell packed into 16 bits, so every
+// neighbourhood query reads a single array
+typedef uint16_t Cell;
+
+#define CELL_WALL      0x8000
+#define CELL_AGENT     0x4000
+#define CELL_BORDER    0x2000 // on the board edge, neighbours wrap around
+#define CELL_FOOD_MASK 0x1fff // food amount, saturates at CELL_FOOD_MAX
+#define CELL_FOOD_MAX  CELL_FOOD_MASK
+
+#define CELL_FOOD(cell) ((cell) & CELL_FOOD_MASK)
+
+typedef enum {
+    ENGINE_SERIAL = 0,
+    ENGINE_TILES,
+    ENGINE_INTENTS,
+    ENGINE_COUNT,
+} Engine;
+
+// Weights of the lifetime metrics in an agent's fitness. A fatal attack
+// removes the attacker, so kills only rewards genomes that die attacking;
+// the default weighs it 0.
+typedef struct {
+    int age;
+    int offspring;
+    int food;
+    int kills;
+} Fitness;
+
+typedef struct {
+    int width;
+    int height;
+    int genesCount;
+    int bestGenesCount;
+    int hallOfFameCount; // 0 reseeds from the recent archive only
+    Fitness fitness;
+    bool hugePages; // back the world with huge pages when available
+    uint64_t seed;
+    Engine engine;
+    int threads;
+    int tileSize;
+    bool planeSensing; // intents engine senses from shifted bit planes
+} GameConfig;
+
+// Purposes of keyed random draws. All world randomness is drawn from
+// KeyRng(seed, step, cell, purpose) streams, so every engine and thread
+// count draws the same numbers for the same cell.
+enum {
+    RNG_PURPOSE_AGENT = 1, // heading, gene index and genome of a placed agent
+    RNG_PURPOSE_REINIT, // archived or random genome for a cell
+    RNG_PURPOSE_WORLD, // wall and food of a cell
+    RNG_PURPOSE_MUTATION, // newborn's gene index and mutations, keyed by its cell
+    RNG_PURPOSE_CLAIM, // intent engine priority, keyed by the claimant's cell
+};
+
+typedef struct TileEngine TileEngine;
+typedef struct IntentEngine IntentEngine;
+typedef struct Game Game;
+
+// Stepper behind StepGame, one per Engine. create sets up the engine's own
+// state and returns NULL on failure; engines without state leave create and
+// destroy NULL. step updates every agent once, StepGame counts the step.
+typedef struct {
+    const char *name;
+    void *(*create)(Game *game, const GameConfig *config);
+    void (*destroy)(void *engine);
+    void (*step)(Game *game, void *engine);
+} EngineOps;
+
+struct Game {
+    int width;
+    int height;
+    int cellsCount;
+    int genesCount;
+    // Power-of-two boards wrap with masks instead of the border slow path
+    bool powerOfTwo;
+    int widthMask;
+    int cellsMask;
+    int neighborOffsets[4][SIDE_COUNT]; // interior cells, [dir][side]
+    int neighborDx[4][SIDE_COUNT];
+    int neighborDy[4][SIDE_COUNT]; // already multiplied by width
+
+    Agents agents;
+    AgentHandle *grid; // cellsCount
+    Cell *cells; // cellsCount
+    // Bit planes mirroring cells, kept in step with every cell write
+    Bitboard wallBits;
+    Bitboard foodBits; // food above zero
+    Bitboard agentBits;
+    uint64_t cellsHash; // xor of a hash of every non-empty cell, kept by every cell write
+    // Ring of the genomes of the last bestGenesMax agents that died
+    PackedGene *bestGenes; // bestGenesMax*genesCount
+    int bestGenesMax;
+    int bestGenesCount;
+    int bestGenesHead; // slot of the newest genome
+    // Fittest genomes of all agents that died since InitGame, ReinitGame
+    // prefers them to the recent archive
+    HallOfFame hall;
+    Fitness fitness;
+    bool allDie; // count == 0 after a step, no board pass needed
+    long step; // steps since the world was created
+
+    const EngineOps *engineOps;
+    void *engine; // state of engineOps, NULL for the serial engine
+
+    uint64_t seed;
+
+    void *memory;
+    size_t memorySize;
+    bool hugePages;
+};
+
+// Simulation core, no rendering or windowing dependencies (libsim)
+void SeedGame(Game *game, uint64_t seed);
+
+Dir RandomDir(Rng *rng);
+Condition RandomCondition(Rng *rng);
+Action RandomAction(Rng *rng);
+Dir GetReverseDir(Dir dir);
+Dir TurnLeft(Dir dir);
+Dir TurnRight(Dir dir);
+
+char *DirToStr(Dir dir);
+char *ConditionToStr(Condition cond);
+char *ActionToStr(Action action);
+
+GameConfig DefaultGameConfig(void);
+bool SetGameConfigValue(GameConfig *config, const char *key, const char *value);
+bool LoadGameConfig(GameConfig *config, const char *path);
+int ParseGameOption(GameConfig *config, int argc, char **argv, int i);
+const char *GameOptionsUsage(void);
+
+const EngineOps *GetEngineOps(Engine engine);
+Game *CreateGame(const GameConfig *config);
+void DestroyGame(Game *game);
+
+int AgentIndex(Game *game, AgentHandle handle);
+bool IsAgentAlive(Game *game, AgentHandle handle);
+
+// Places an agent carrying genes, returns its index or -1 if the store is full
+int AddAgent(Game *game, int cell, const PackedGene *genes);
+void RemoveAgent(Game *game, int agent);
+// Returns the entry holding genes with one more reference, adding it if new
+int InternGenome(Game *game, const PackedGene *genes);
+void ReleaseGenome(Game *game, int genome);
+int CountSpecies(const Game *game);
+Agent GetAgent(Game *game, int agent);
+const PackedGene *GetAgentGenes(const Game *game, int agent);
+
+AgentHandle RandomAgent(Game *game, int cell);
+AgentHandle ReproduceAgent(Game *game, int parent, int cell);
+AgentHandle AgentFromGenes(Game *game, const PackedGene *genes, int cell);
+void KillAgent(Game *game, int agent);
+void VacateAgent(Game *game, int agent);
+void FreeAgent(Game *game, int agent);
+void ArchiveGenes(Game *game, const PackedGene *genes);
+// i-th newest archived genome, 0 <= i < bestGenesCount
+PackedGene *GetBestGenes(const Game *game, int i);
+uint64_t HashGenes(const PackedGene *genes, int count);
+long AgentFitness(const Game *game, int agent);
+// Archives a dying agent's genome and offers it to the hall of fame
+void ArchiveAgent(Game *game, int agent);
+
+// State one agent update needs besides the Game. The serial step removes
+// dead agents right away; engines that update agents concurrently defer
+// removal by passing a dead list and lock the store around births.
+typedef struct {
+    int *dead; // indices of agents killed during the update, NULL to remove them at once
+    int deadCount;
+    pthread_mutex_t *lock;
+    uint64_t cellsHash; // cellsHash changes of a concurrent update, folded in by the engine
+} StepContext;
+
+AgentHandle ReproduceAgentWith(Game *game, StepContext *ctx, int parent, int cell);
+void KillAgentWith(Game *game, StepContext *ctx, int agent);
+void BuryAgents(Game *game, int *dead, int count);
+
+typedef enum {
+    INTENT_MOVE,
+    INTENT_ATTACK,
+    INTENT_EAT,
+    INTENT_REPRODUCE,
+    INTENT_DIE,
+} IntentKind;
+
+// Board change an agent asks for in the decide phase. target is a cell,
+// or the attacked agent's index for INTENT_ATTACK.
+typedef struct {
+    int agent;
+    int target;
+    IntentKind kind;
+} Intent;
+
+// What an agent sees before it acts: bit (side*SENSOR_KINDS + kind) for
+// each sensed side and each kind below, plus a bit that is always set.
+// Every condition tests exactly one bit.
+enum {
+    SENSOR_FREE = 0,
+    SENSOR_FOOD,
+    SENSOR_AGENT,
+    SENSOR_WALL,
+    SENSOR_KINDS,
+};
+
+// Sensed sides, not numbered like Side, which also has the back
+enum {
+    SENSOR_FRONT = 0,
+    SENSOR_LEFT,
+    SENSOR_RIGHT,
+    SENSOR_SIDES,
+};
+
+typedef uint16_t SensorMask;
+
+#define SENSOR_BIT(side, kind) ((side)*SENSOR_KINDS + (kind))
+#define SENSOR_ALWAYS_BIT (SENSOR_SIDES*SENSOR_KINDS)
+
+SensorMask SenseAgent(const Game *game, int agent);
+// Senses agents [from, to) into sensors[from..to)
+void SenseAgents(const Game *game, int from, int to, SensorMask *sensors);
+bool SensorCondition(SensorMask sensors, Condition cond);
+
+// Whole-board sensing: plane SENSOR_PLANE(dir, kind) holds, for every cell,
+// whether its neighbour in direction dir has food, an agent or a wall.
+#define SENSOR_PLANES (4*(SENSOR_KINDS - 1))
+#define SENSOR_PLANE(dir, kind) ((dir)*(SENSOR_KINDS - 1) + (kind) - SENSOR_FOOD)
+
+// Fills planes [from, to) of the SENSOR_PLANES bitboards of cellsCount bits
+void ShiftSensorPlanes(const Game *game, Bitboard *planes, int from, int to);
+// Senses the agents on the cells of plane words [from, to) into sensors by
+// agent index, walking the board in cell order so the planes stream. Gives
+// the same masks as SenseAgents on the board the planes were filled from.
+void SenseAgentsFromPlanes(const Game *game, const Bitboard *planes, int from, int to, SensorMask *sensors);
+
+// Decides agents [from, to) from their sensor masks, sensed on the same
+// board, and writes their intents, returns how many. Turns and idle genes
+// change only the agent itself and emit nothing.
+int DecideAgents(Game *game, int from, int to, const SensorMask *sensors, Intent *intents);
+void ApplyIntent(Game *game, StepContext *ctx, const Intent *intent);
+
+Pos ToBoardPos(Game *game, Pos pos);
+Pos GetFrontPos(Game *game, Dir dir, Pos pos);
+Pos GetBackPos(Game *game, Dir dir, Pos pos);
+Pos GetLeftPos(Game *game, Dir dir, Pos pos);
+Pos GetRightPos(Game *game, Dir dir, Pos pos);
+int PosToCell(Game *game, Pos pos);
+Pos CellToPos(Game *game, int cell);
+int WrapNeighborCell(const Game *game, int cell, Dir dir, Side side);
+bool IsCellFree(Game *game, int cell);
+void SetFood(Game *game, int cell, int food);
+// Popcounts of the bit planes
+int CountFoodCells(const Game *game);
+int CountWalls(const Game *game);
+int CountPopulation(const Game *game);
+
+// 64-bit hash of the world: step, cells, agents (by cell, so neither store
+// order nor handles count), the archive and the hall of fame. The cells
+// part is kept incrementally, the rest is summed on each call.
+uint64_t HashGame(const Game *game);
+// cellsHash recomputed from the board, for checking the incremental one
+uint64_t RehashCells(const Game *game);
+
+// Copy of a world between two steps. It can only be restored into the game
+// it was saved from. It holds the board, the used prefix of the agent, slot
+// and genome arrays, the live genomes, the archive and the hall of fame,
+// not the whole world mapping.
+typedef struct GameState GameState;
+
+GameState *SaveGameState(const Game *game);
+void RestoreGameState(Game *game, const GameState *state);
+void FreeGameState(GameState *state);
+
+// Neighbour lookup with the topology passed explicitly, so callers that
+// dispatch on game->powerOfTwo once get a specialized copy of their loop
+static inline int NeighborCellOf(const Game *game, int cell, Dir dir, Side side, bool powerOfTwo) {
+    if (powerOfTwo) {
+        int row = ((cell & ~game->widthMask) + game->neighborDy[dir][side]) & game->cellsMask;
+        return row | ((cell + game->neighborDx[dir][side]) & game->widthMask);
+    }
+    if (game->cells[cell] & CELL_BORDER) return WrapNeighborCell(game, cell, dir, side);
+    return cell + game->neighborOffsets[dir][side];
+}
+
+static inline int NeighborCell(const Game *game, int cell, Dir dir, Side side) {
+    return NeighborCellOf(game, cell, dir, side, game->powerOfTwo);
+}
+
+bool ExecuteCondition(Game *game, int agent, Condition cond);
+void ExecuteAction(Game *game, int agent, Action action);
+void UpdateAgent(Game *game, int agent);
+void UpdateAgentWith(Game *game, StepContext *ctx, int agent);
+void StepGame(Game *game);
+
+void CreateWallsAndFoods(Game *game);
+void ClearGame(Game *game);
+void InitGame(Game *game);
+void ReinitGame(Game *game);
+
+#endif
@@ -0,0 +1,205 @@
+#include "tiles.h"
+#include "workers.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define PHASES_COUNT 4
+// Bounds the per-tile arrays and the scheduling overhead; tile sizes are
+// doubled until a board has at most this many tiles
+#define TILES_MAX (1 << 24)
+
+struct TileEngine {
+    Game *game;
+    int tilesX;
+    int tilesY;
+    int tilesCount;
+    int *tileOfX; // tile column of every board column
+    int *tileOfY;
+
+    // Tiles of every phase, ascending, phaseTiles[phaseStart[p]..phaseStart[p+1])
+    int *phaseTiles;
+    int phaseStart[PHASES_COUNT + 1];
+
+    // Cells of the agents alive at the start of the step grouped by tile,
+    // bucket[tileStart[t]..tileStart[t+1]). The dead list of a tile uses the
+    // same range of dead.
+    int *tileStart;
+    int *tileFill;
+    int *bucket;
+    int *dead;
+    int *deadCount;
+    int bucketCapacity;
+
+    pthread_mutex_t lock; // agent store, births only
+    Workers workers;
+    atomic_int nextTile;
+    int phase;
+};
+
+static int TileCount(int size, int tileSize) {
+    // Colours alternate across the wrap as well, so the count must be even
+    int n = size / tileSize;
+    n -= n % 2;
+    return (n >= 2) ? n : 1;
+}
+
+static void InitTileAxis(int *tileOf, int size, int tiles) {
+    for (int t = 0; t < tiles; t++) {
+        int from = (int)((long long)t*size/tiles);
+        int to = (int)((long long)(t + 1)*size/tiles);
+        for (int i = from; i < to; i++) tileOf[i] = t;
+    }
+}
+
+static int CompareCells(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static void StepTile(TileEngine *engine, int tile) {
+    PROFILE_ZONE_ARG("StepTile", tile);
+    Game *game = engine->game;
+    int *cells = &engine->bucket[engine->tileStart[tile]];
+    int n = engine->tileStart[tile + 1] - engine->tileStart[tile];
+    qsort(cells, n, sizeof(int), CompareCells);
+
+    StepContext ctx = {
+        .dead = &engine->dead[engine->tileStart[tile]],
+        .lock = &engine->lock,
+    };
+    // Nothing can enter a bucketed cell before its agent has run, so the
+    // cell still holds the agent it was bucketed for
+    for (int i = 0; i < n; i++) {
+        int agent = AgentIndex(game, game->grid[cells[i]]);
+        if (agent >= 0) UpdateAgentWith(game, &ctx, agent);
+    }
+    engine->deadCount[tile] = ctx.deadCount;
+    __atomic_fetch_xor(&game->cellsHash, ctx.cellsHash, __ATOMIC_RELAXED);
+}
+
+static void RunPhase(void *arg, int worker) {
+    (void)worker; // tiles are shared out through nextTile
+    TileEngine *engine = arg;
+    int p = engine->phase;
+    int count = engine->phaseStart[p + 1] - engine->phaseStart[p];
+    int i;
+    while ((i = atomic_fetch_add(&engine->nextTile, 1)) < count) {
+        StepTile(engine, engine->phaseTiles[engine->phaseStart[p] + i]);
+    }
+}
+
+TileEngine *CreateTileEngine(Game *game, int threads, int tileSize) {
+    TileEngine *engine = calloc(1, sizeof(TileEngine));
+    if (engine == NULL) return NULL;
+    engine->game = game;
+    pthread_mutex_init(&engine->lock, NULL);
+    InitWorkers(&engine->workers, threads);
+
+    if (tileSize < 2) tileSize = 2;
+    do {
+        engine->tilesX = TileCount(game->width, tileSize);
+        engine->tilesY = TileCount(game->height, tileSize);
+        tileSize *= 2;
+    } while ((long long)engine->tilesX*engine->tilesY > TILES_MAX);
+    engine->tilesCount = engine->tilesX*engine->tilesY;
+
+    int tiles = engine->tilesCount;
+    engine->bucketCapacity = game->agents.capacity;
+    engine->tileOfX = malloc(game->width*sizeof(int));
+    engine->tileOfY = malloc(game->height*sizeof(int));
+    engine->phaseTiles = malloc(tiles*sizeof(int));
+    engine->tileStart = malloc((tiles + 1)*sizeof(int));
+    engine->tileFill = malloc(tiles*sizeof(int));
+    engine->deadCount = malloc(tiles*sizeof(int));
+    engine->bucket = malloc(engine->bucketCapacity*sizeof(int));
+    engine->dead = malloc(engine->bucketCapacity*sizeof(int));
+    if (!engine->tileOfX || !engine->tileOfY || !engine->phaseTiles || !engine->tileStart ||
+        !engine->tileFill || !engine->deadCount || !engine->bucket || !engine->dead) {
+        DestroyTileEngine(engine);
+        return NULL;
+    }
+    InitTileAxis(engine->tileOfX, game->width, engine->tilesX);
+    InitTileAxis(engine->tileOfY, game->height, engine->tilesY);
+
+    int k = 0;
+    for (int p = 0; p < PHASES_COUNT; p++) {
+        engine->phaseStart[p] = k;
+        for (int t = 0; t < tiles; t++) {
+            int tx = t % engine->tilesX;
+            int ty = t / engine->tilesX;
+            if ((ty % 2)*2 + tx % 2 == p) engine->phaseTiles[k++] = t;
+        }
+    }
+    engine->phaseStart[PHASES_COUNT] = k;
+
+    return engine;
+}
+
+void DestroyTileEngine(TileEngine *engine) {
+    if (engine == NULL) return;
+    FreeWorkers(&engine->workers);
+    pthread_mutex_destroy(&engine->lock);
+    free(engine->tileOfX);
+    free(engine->tileOfY);
+    free(engine->phaseTiles);
+    free(engine->tileStart);
+    free(engine->tileFill);
+    free(engine->deadCount);
+    free(engine->bucket);
+    free(engine->dead);
+    free(engine);
+}
+
+// Counting sort of the live agents' cells by tile
+static void FillBuckets(TileEngine *engine) {
+    PROFILE_ZONE("FillBuckets");
+    Game *game = engine->game;
+    Agents *agents = &game->agents;
+    int width = game->width;
+    memset(engine->tileFill, 0, engine->tilesCount*sizeof(int));
+    for (int a = 0; a < agents->count; a++) {
+        int cell = agents->cell[a];
+        int t = engine->tileOfY[cell / width]*engine->tilesX + engine->tileOfX[cell % width];
+        engine->tileFill[t]++;
+    }
+    int start = 0;
+    for (int t = 0; t < engine->tilesCount; t++) {
+        engine->tileStart[t] = start;
+        start += engine->tileFill[t];
+        engine->tileFill[t] = engine->tileStart[t];
+    }
+    engine->tileStart[engine->tilesCount] = start;
+    for (int a = 0; a < agents->count; a++) {
+        int cell = agents->cell[a];
+        int t = engine->tileOfY[cell / width]*engine->tilesX + engine->tileOfX[cell % width];
+        engine->bucket[engine->tileFill[t]++] = cell;
+    }
+}
+
+// Gathers the agents that died this step in phase and tile order
+static void BuryDead(TileEngine *engine) {
+    PROFILE_ZONE("BuryDead");
+    int count = 0;
+    for (int i = 0; i < engine->phaseStart[PHASES_COUNT]; i++) {
+        int t = engine->phaseTiles[i];
+        int *dead = &engine->dead[engine->tileStart[t]];
+        for (int d = 0; d < engine->deadCount[t]; d++) {
+            engine->bucket[count++] = dead[d];
+        }
+    }
+    BuryAgents(engine->game, engine->bucket, count);
+}
+
+void StepTileEngine(TileEngine *engine) {
+    FillBuckets(engine);
+    for (int p = 0; p < PHASES_COUNT; p++) {
+        PROFILE_ZONE_ARG("phase", p);
+        engine->phase = p;
+        atomic_store(&engine->nextTile, 0);
+        RunWorkers(&engine->workers, RunPhase, engine);
+    }
+    BuryDead(engine);
+}
@@ -0,0 +1,20 @@
+#ifndef TILES_H_
+#define TILES_H_
+
+#include "sim.h"
+
+// Steps the world in parallel. The board is cut into an even number of
+// tiles per axis and each step runs four phases, one per checkerboard
+// colour (tx%2, ty%2). An agent only touches cells within one step of its
+// own, so tiles of the same colour never share a cell and run concurrently
+// on a small pthread pool with a barrier between phases.
+//
+// Within a tile agents are updated in raster order, and random draws are
+// keyed by cell (see KeyRng). Deaths are archived and freed in tile order
+// once all phases are done. The world therefore evolves identically for
+// any thread count; only agent handles and store order may differ.
+TileEngine *CreateTileEngine(Game *game, int threads, int tileSize);
+void DestroyTileEngine(TileEngine *engine);
+void StepTileEngine(TileEngine *engine);
+
+#endif
@@ -0,0 +1,420 @@
+#include "sim.h"
+#include "reference.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_VERSION 1
+#define TRACE_LINE_MAX 4096
+#define TRACE_ARGS_MAX 64
+#define DUMP_CELLS_MAX 32
+#define SOAK_THREADS 4 // threads of a tiles or intents soak without --threads
+
+static void Usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s record [--steps N] [--every K] [options] > TRACE\n"
+        "       %s check TRACE [options]\n"
+        "       %s diff [--steps N] [--every K] [options] -- [candidate options]\n"
+        "       %s soak [--seconds S] [--steps N] [--every K] [options]\n"
+        "\n"
+        "record  writes the world hash every K steps of a seeded run\n"
+        "check   replays a trace's run, options override the recorded ones, and\n"
+        "        reports the first recorded step whose hash differs\n"
+        "diff    runs a reference and a candidate world in lockstep, bisects to\n"
+        "        the first step where their hashes differ and dumps the cells\n"
+        "        that differ\n"
+        "soak    diffs rounds of N steps with new seeds and board sizes for S\n"
+        "        seconds (default 3600, 0 runs until a divergence); serial is\n"
+        "        compared with the reference rules after every step, tiles and\n"
+        "        intents (--threads, default %d) only with themselves on one\n"
+        "        thread every K steps\n"
+        "%s", name, name, name, name, SOAK_THREADS, GameOptionsUsage());
+}
+
+// Steps the world as live-headless does, reseeding it after an extinction
+static void Advance(Game *game) {
+    if (game->allDie) ReinitGame(game);
+    StepGame(game);
+}
+
+static Game *StartGame(const GameConfig *config) {
+    Game *game = CreateGame(config);
+    if (game == NULL) {
+        fprintf(stderr, "failed to allocate a %dx%d world\n", config->width, config->height);
+        return NULL;
+    }
+    InitGame(game);
+    return game;
+}
+
+// Parses world options from argv[from, to), returns false on a bad one
+static bool ParseOptions(GameConfig *config, char **argv, int from, int to) {
+    for (int i = from; i < to;) {
+        int n = ParseGameOption(config, to, argv, i);
+        if (n <= 0) {
+            fprintf(stderr, "bad option %s\n", argv[i]);
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+// Replaces the saved states of both worlds with their current ones
+static void SaveStates(GameState **referenceState, GameState **candidateState, const Game *reference, const Game *candidate) {
+    FreeGameState(*referenceState);
+    FreeGameState(*candidateState);
+    *referenceState = SaveGameState(reference);
+    *candidateState = SaveGameState(candidate);
+    if (*referenceState == NULL || *candidateState == NULL) {
+        fprintf(stderr, "failed to copy the worlds\n");
+        exit(1);
+    }
+}
+
+// Parses the leading --steps N, --every K and, given seconds, --seconds S
+// pairs, returns the index of the first other argument
+static int ParseSteps(int argc, char **argv, long *steps, long *every, double *seconds) {
+    int first = 2;
+    while (first + 1 < argc) {
+        if (strcmp(argv[first], "--steps") == 0) {
+            *steps = atol(argv[first + 1]);
+        } else if (strcmp(argv[first], "--every") == 0) {
+            *every = atol(argv[first + 1]);
+        } else if (seconds != NULL && strcmp(argv[first], "--seconds") == 0) {
+            *seconds = atof(argv[first + 1]);
+        } else {
+            break;
+        }
+        first += 2;
+    }
+    return first;
+}
+
+static int Record(int argc, char **argv) {
+    GameConfig config = DefaultGameConfig();
+    long steps = 1000;
+    long every = 1;
+    int first = ParseSteps(argc, argv, &steps, &every, NULL);
+    if (steps < 0 || every <= 0 || !ParseOptions(&config, argv, first, argc)) return 1;
+    Game *game = StartGame(&config);
+    if (game == NULL) return 1;
+
+    // A run seeded from the clock records its seed to replay as well
+    bool seeded = false;
+    printf("live-trace %d\noptions", TRACE_VERSION);
+    for (int i = first; i < argc; i++) {
+        printf(" %s", argv[i]);
+        seeded = seeded || strcmp(argv[i], "--seed") == 0;
+    }
+    if (!seeded) printf(" --seed %llu", (unsigned long long)game->seed);
+    printf("\n");
+    printf("%ld %016llx\n", 0L, (unsigned long long)HashGame(game));
+    for (long step = 1; step <= steps; step++) {
+        Advance(game);
+        if (step % every == 0 || step == steps) {
+            printf("%ld %016llx\n", step, (unsigned long long)HashGame(game));
+        }
+    }
+    DestroyGame(game);
+    return 0;
+}
+
+static int Check(int argc, char **argv) {
+    if (argc < 3) {
+        Usage(argv[0]);
+        return 1;
+    }
+    FILE *file = fopen(argv[2], "r");
+    if (file == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+    char header[TRACE_LINE_MAX];
+    char options[TRACE_LINE_MAX];
+    int version = 0;
+    if (!fgets(header, sizeof(header), file) || sscanf(header, "live-trace %d", &version) != 1 ||
+        version != TRACE_VERSION || !fgets(options, sizeof(options), file) ||
+        strncmp(options, "options", 7) != 0) {
+        fprintf(stderr, "%s is not a live-trace %d file\n", argv[2], TRACE_VERSION);
+        fclose(file);
+        return 1;
+    }
+
+    // Recorded options first, then the ones given here
+    char *args[TRACE_ARGS_MAX];
+    int count = 0;
+    args[count++] = argv[0];
+    for (char *token = strtok(options + 7, " \n"); token != NULL; token = strtok(NULL, " \n")) {
+        if (count == TRACE_ARGS_MAX) break;
+        args[count++] = token;
+    }
+    for (int i = 3; i < argc && count < TRACE_ARGS_MAX; i++) args[count++] = argv[i];
+    GameConfig config = DefaultGameConfig();
+    if (!ParseOptions(&config, args, 1, count)) {
+        fclose(file);
+        return 1;
+    }
+    Game *game = StartGame(&config);
+    if (game == NULL) {
+        fclose(file);
+        return 1;
+    }
+
+    long step = 0;
+    long matched = -1;
+    long recorded;
+    unsigned long long expected;
+    int status = 0;
+    while (fscanf(file, "%ld %llx", &recorded, &expected) == 2) {
+        while (step < recorded) {
+            Advance(game);
+            step++;
+        }
+        uint64_t hash = HashGame(game);
+        if (hash != expected) {
+            printf("step %ld: hash %016llx, trace %016llx\n", step, (unsigned long long)hash, expected);
+            if (matched + 1 < step) {
+                printf("first divergence between steps %ld and %ld\n", matched + 1, step);
+            } else {
+                printf("first divergence at step %ld\n", step);
+            }
+            status = 1;
+            break;
+        }
+        matched = step;
+    }
+    if (status == 0) printf("%ld steps match\n", matched);
+    DestroyGame(game);
+    fclose(file);
+    return status;
+}
+
+static void DescribeCell(Game *game, int cell, char *out, size_t size) {
+    Cell value = game->cells[cell];
+    int n = snprintf(out, size, "%s", (value & CELL_WALL) ? "wall" : "");
+    if (CELL_FOOD(value)) n += snprintf(out + n, size - n, "%sfood %d", n ? ", " : "", CELL_FOOD(value));
+    int a = AgentIndex(game, game->grid[cell]);
+    if (a >= 0) {
+        Agents *agents = &game->agents;
+        n += snprintf(out + n, size - n,
+            "%sagent %s health %d hunger %d gene %d genome %016llx born %ld offspring %d food %d kills %d",
+            n ? ", " : "", DirToStr(agents->dir[a]), agents->health[a], agents->hunger[a], agents->geneIndex[a],
+            (unsigned long long)agents->genomeHash[agents->genome[a]], agents->born[a],
+            agents->offspring[a], agents->foodEaten[a], agents->kills[a]);
+    }
+    if (n == 0) snprintf(out, size, "empty");
+}
+
+static void DumpDifferences(Game *reference, Game *candidate) {
+    if (reference->width != candidate->width || reference->height != candidate->height) {
+        printf("  boards differ in size\n");
+        return;
+    }
+    int differing = 0;
+    for (int cell = 0; cell < reference->cellsCount; cell++) {
+        char a[512];
+        char b[512];
+        DescribeCell(reference, cell, a, sizeof(a));
+        DescribeCell(candidate, cell, b, sizeof(b));
+        if (strcmp(a, b) == 0) continue;
+        if (differing++ < DUMP_CELLS_MAX) {
+            printf("  %d,%d\n    reference: %s\n    candidate: %s\n", cell % reference->width, cell / reference->width, a, b);
+        }
+    }
+    if (differing > DUMP_CELLS_MAX) printf("  ... %d cells differ\n", differing);
+    if (differing == 0) printf("  cells and agents match, the archive or the hall of fame differs\n");
+}
+
+// Brings both worlds from the states at step lo to step to
+static void Replay(Game *reference, Game *candidate, const GameState *referenceState,
+    const GameState *candidateState, long lo, long to) {
+    RestoreGameState(reference, referenceState);
+    RestoreGameState(candidate, candidateState);
+    for (long step = lo; step < to; step++) {
+        Advance(reference);
+        Advance(candidate);
+    }
+}
+
+// Runs both worlds in lockstep for steps steps. Hashes are compared every
+// K steps; on a mismatch the interval since the last match is bisected from
+// the states saved there and the first divergent step is reported. Returns
+// 0 when every compared step matched.
+static int Lockstep(Game *reference, Game *candidate, long steps, long every) {
+    long good = 0;
+    GameState *referenceState = NULL;
+    GameState *candidateState = NULL;
+    SaveStates(&referenceState, &candidateState, reference, candidate);
+    int status = 0;
+    if (HashGame(reference) != HashGame(candidate)) {
+        printf("worlds differ after InitGame\n");
+        DumpDifferences(reference, candidate);
+        status = 1;
+    }
+    for (long step = 1; step <= steps && status == 0; step++) {
+        Advance(reference);
+        Advance(candidate);
+        if (step % every != 0 && step != steps) continue;
+        if (HashGame(reference) == HashGame(candidate)) {
+            SaveStates(&referenceState, &candidateState, reference, candidate);
+            good = step;
+            continue;
+        }
+
+        long bad = step;
+        while (bad - good > 1) {
+            long mid = good + (bad - good)/2;
+            Replay(reference, candidate, referenceState, candidateState, good, mid);
+            if (HashGame(reference) == HashGame(candidate)) {
+                SaveStates(&referenceState, &candidateState, reference, candidate);
+                good = mid;
+            } else {
+                bad = mid;
+            }
+        }
+        Replay(reference, candidate, referenceState, candidateState, good, bad);
+        printf("first divergence at step %ld\n", bad);
+        DumpDifferences(reference, candidate);
+        status = 1;
+    }
+    FreeGameState(referenceState);
+    FreeGameState(candidateState);
+    return status;
+}
+
+static int Diff(int argc, char **argv) {
+    long steps = 1000;
+    long every = 64;
+    int first = ParseSteps(argc, argv, &steps, &every, NULL);
+    int split = first;
+    while (split < argc && strcmp(argv[split], "--") != 0) split++;
+    GameConfig referenceConfig = DefaultGameConfig();
+    if (steps < 0 || every <= 0 || !ParseOptions(&referenceConfig, argv, first, split)) return 1;
+    GameConfig candidateConfig = referenceConfig;
+    if (split < argc && !ParseOptions(&candidateConfig, argv, split + 1, argc)) return 1;
+    // Both worlds have to draw from the same seed
+    candidateConfig.seed = referenceConfig.seed;
+
+    Game *reference = StartGame(&referenceConfig);
+    Game *candidate = reference ? StartGame(&candidateConfig) : NULL;
+    if (candidate == NULL) {
+        DestroyGame(reference);
+        return 1;
+    }
+    printf("seed %llu\n", (unsigned long long)reference->seed);
+    int status = Lockstep(reference, candidate, steps, every);
+    if (status == 0) printf("%ld steps match\n", steps);
+    DestroyGame(reference);
+    DestroyGame(candidate);
+    return status;
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Board sizes the soak rounds cycle through: the default, a power of two
+// one, an odd one and a square power of two one
+static const int soakSizes[][2] = {
+    {BOARD_WIDTH, BOARD_HEIGHT},
+    {128, 64},
+    {67, 45},
+    {256, 256},
+};
+
+#define SOAK_SIZES_COUNT (int)(sizeof(soakSizes)/sizeof(soakSizes[0]))
+
+// Steps a serial world and the reference rules side by side and compares
+// their whole state after every step. An extinction reseeds the world with
+// ReinitGame and the reference copies it again.
+static int RunAgainstReference(Game *game, long steps) {
+    ReferenceWorld *world = CreateReferenceWorld(game);
+    int status = 0;
+    for (long step = 1; step <= steps && world != NULL && status == 0; step++) {
+        if (game->allDie) {
+            ReinitGame(game);
+            DestroyReferenceWorld(world);
+            world = CreateReferenceWorld(game);
+            if (world == NULL) break;
+        }
+        StepGame(game);
+        StepReferenceWorld(world);
+        if (DiffReferenceWorld(world, game, NULL, 0) == 0) continue;
+        printf("first divergence from the reference at step %ld\n", game->step);
+        DiffReferenceWorld(world, game, stdout, DUMP_CELLS_MAX);
+        status = 1;
+    }
+    if (world == NULL) {
+        fprintf(stderr, "failed to copy the world\n");
+        return 1;
+    }
+    DestroyReferenceWorld(world);
+    return status;
+}
+
+// Rounds with a new seed and board size each, until one diverges or the
+// time is up. The serial engine is checked against the reference rules.
+// The tiles and intents engines update in other orders by design, so they
+// are only checked against themselves on one thread, which catches races
+// but not rule changes.
+static int Soak(int argc, char **argv) {
+    long steps = 2000;
+    long every = 64;
+    double seconds = 3600;
+    int first = ParseSteps(argc, argv, &steps, &every, &seconds);
+    GameConfig candidateConfig = DefaultGameConfig();
+    candidateConfig.threads = 0;
+    if (steps < 0 || every <= 0 || seconds < 0 || !ParseOptions(&candidateConfig, argv, first, argc)) return 1;
+    bool serial = candidateConfig.engine == ENGINE_SERIAL;
+    if (candidateConfig.threads == 0) candidateConfig.threads = serial ? 1 : SOAK_THREADS;
+    if (!serial && candidateConfig.threads == 1) {
+        fprintf(stderr, "a one-thread %s candidate is its own reference, pass --threads 2 or more\n",
+            GetEngineOps(candidateConfig.engine)->name);
+        return 1;
+    }
+    GameConfig referenceConfig = candidateConfig;
+    referenceConfig.threads = 1;
+    if (serial) {
+        printf("soak: serial against the reference rules, seed %llu\n", (unsigned long long)candidateConfig.seed);
+    } else {
+        printf("soak: %s on %d threads against itself on one thread, seed %llu\n", GetEngineOps(candidateConfig.engine)->name,
+            candidateConfig.threads, (unsigned long long)candidateConfig.seed);
+    }
+
+    double start = Now();
+    int status = 0;
+    long round = 0;
+    while (status == 0 && (seconds == 0 || Now() - start < seconds)) {
+        const int *size = soakSizes[round % SOAK_SIZES_COUNT];
+        candidateConfig.width = referenceConfig.width = size[0];
+        candidateConfig.height = referenceConfig.height = size[1];
+        candidateConfig.seed = referenceConfig.seed = candidateConfig.seed + (round > 0);
+        Game *reference = serial ? NULL : StartGame(&referenceConfig);
+        Game *candidate = (serial || reference) ? StartGame(&candidateConfig) : NULL;
+        if (candidate == NULL) {
+            DestroyGame(reference);
+            return 1;
+        }
+        printf("round %ld: %dx%d seed %llu\n", round, size[0], size[1], (unsigned long long)candidateConfig.seed);
+        fflush(stdout);
+        status = serial ? RunAgainstReference(candidate, steps) : Lockstep(reference, candidate, steps, every);
+        DestroyGame(reference);
+        DestroyGame(candidate);
+        round++;
+    }
+    if (status == 0) printf("%ld rounds of %ld steps match in %.0f s\n", round, steps, Now() - start);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "record") == 0) return Record(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "check") == 0) return Check(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "diff") == 0) return Diff(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "soak") == 0) return Soak(argc, argv);
+    Usage(argv[0]);
+    return 1;
+}
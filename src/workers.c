@@ -0,0 +1,90 @@
+#include "workers.h"
+#include "profile.h"
+#include <stdlib.h>
+
+typedef struct {
+    Workers *workers;
+    int index;
+} WorkerArg;
+
+static void *WorkerMain(void *arg) {
+    Workers *workers = ((WorkerArg *)arg)->workers;
+    int index = ((WorkerArg *)arg)->index;
+    free(arg);
+    PROFILE_THREAD("worker", index);
+
+    pthread_mutex_lock(&workers->lock);
+    long seen = 0;
+    for (;;) {
+        while (workers->job == seen && !workers->quit) {
+            pthread_cond_wait(&workers->wake, &workers->lock);
+        }
+        if (workers->quit) break;
+        seen = workers->job;
+        pthread_mutex_unlock(&workers->lock);
+
+        workers->fn(workers->arg, index);
+
+        pthread_mutex_lock(&workers->lock);
+        if (--workers->pending == 0) pthread_cond_signal(&workers->idle);
+    }
+    pthread_mutex_unlock(&workers->lock);
+    return NULL;
+}
+
+void InitWorkers(Workers *workers, int count) {
+    *workers = (Workers){.count = 1};
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->wake, NULL);
+    pthread_cond_init(&workers->idle, NULL);
+    if (count < 2) return;
+
+    workers->threads = malloc((count - 1)*sizeof(pthread_t));
+    if (workers->threads == NULL) return;
+    for (int i = 1; i < count; i++) {
+        WorkerArg *arg = malloc(sizeof(WorkerArg));
+        if (arg == NULL) break;
+        *arg = (WorkerArg){workers, i};
+        if (pthread_create(&workers->threads[i - 1], NULL, WorkerMain, arg) != 0) {
+            free(arg);
+            break;
+        }
+        workers->count++;
+    }
+}
+
+void FreeWorkers(Workers *workers) {
+    pthread_mutex_lock(&workers->lock);
+    workers->quit = true;
+    pthread_cond_broadcast(&workers->wake);
+    pthread_mutex_unlock(&workers->lock);
+    for (int i = 0; i < workers->count - 1; i++) {
+        pthread_join(workers->threads[i], NULL);
+    }
+    free(workers->threads);
+    pthread_cond_destroy(&workers->idle);
+    pthread_cond_destroy(&workers->wake);
+    pthread_mutex_destroy(&workers->lock);
+}
+
+void RunWorkers(Workers *workers, WorkFn fn, void *arg) {
+    if (workers->count == 1) {
+        fn(arg, 0);
+        return;
+    }
+    pthread_mutex_lock(&workers->lock);
+    workers->fn = fn;
+    workers->arg = arg;
+    workers->pending = workers->count - 1;
+    workers->job++;
+    pthread_cond_broadcast(&workers->wake);
+    pthread_mutex_unlock(&workers->lock);
+
+    fn(arg, 0);
+
+    pthread_mutex_lock(&workers->lock);
+    while (workers->pending > 0) {
+        pthread_cond_wait(&workers->idle, &workers->lock);
+    }
+    pthread_mutex_unlock(&workers->lock);
+}
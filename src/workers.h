@@ -0,0 +1,30 @@
+#ifndef WORKERS_H_
+#define WORKERS_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+typedef void (*WorkFn)(void *arg, int worker);
+
+// Fixed set of threads that run one job at a time. The calling thread is
+// worker 0 and takes part in every job, so a single worker spawns nothing.
+typedef struct {
+    int count;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    long job; // bumped for every job, starts at 0
+    int pending; // spawned workers still running the current job
+    WorkFn fn;
+    void *arg;
+    bool quit;
+} Workers;
+
+// Starts up to count - 1 threads; count is lowered if some fail to start
+void InitWorkers(Workers *workers, int count);
+void FreeWorkers(Workers *workers);
+// Runs fn(arg, worker) on every worker and returns once all have finished
+void RunWorkers(Workers *workers, WorkFn fn, void *arg);
+
+#endif